@@ -28,567 +28,2481 @@
  */
 
 #include "ch32v_pwm.h"
+#include "ch32v_pwm_dma.h"
+
+#define PWM_START_POLLS     1000    // Polls of a slave counter enable in start_pwm_group(), the trigger takes a few clock cycles
+
+// Per-timer state shared by all handles on a timer
+typedef struct
+{
+    PWM_handle *channels[4];                // Handles initialized on this timer (index = channel - 1)
+    uint32_t f_base;                        // Frequency requested for this timer
+    uint16_t prescaler;                     // Prescaler of this timer
+    uint16_t arr;                           // Period of this timer
+    uint8_t freq_policy;                    // PWM_FREQ_REJECT or PWM_FREQ_RESCALE, 0 = PWM_FREQ_POLICY
+    uint8_t counter_mode;                   // PWM_COUNT_UP, PWM_COUNT_CENTER1, PWM_COUNT_CENTER2 or PWM_COUNT_CENTER3
+    uint8_t update_mode;                    // PWM_UPDATE_BOTH, PWM_UPDATE_TOP or PWM_UPDATE_BOTTOM (center-aligned only)
+    uint8_t center;                         // 1 if center-aligned, period is 2 * (PSC + 1) * (arr + 1) and ATRLR = arr + 1
+    pwm_update_callback update_callback;    // Called by pwm_irq_handler() on update event
+    pwm_break_callback break_callback;      // Called by pwm_irq_handler() on break event
+    uint16_t break_pin;                     // Break input pin claimed by enable_pwm_break() (0 = none)
+    uint16_t *arr_table;                    // Period sequence streamed by DMA (NULL = update interrupt)
+    uint32_t arr_frac;                      // Periods with one count more per arr_den periods
+    uint32_t arr_den;                       // Length of period sequence (0 = no frequency dithering)
+    uint32_t arr_acc;                       // Sigma-delta accumulator of update interrupt frequency dithering
+    uint8_t master;                         // Timer clocking this one by its update events (0 = internal clock)
+    uint32_t f_millihz;                     // Frequency requested for a cascaded timer in mHz
+    pwm_burst_callback burst_callback;      // Called by pwm_irq_handler() at the end of a burst
+    volatile uint32_t burst_left;           // Repetition counter segments left until the burst ends (0 = no burst)
+    uint8_t burst_dma;                      // Segment lengths are streamed into RPTCR by DMA
+    PWM_capture *capture;                   // Input measurement using this timer (NULL = none), timer is reserved for it
+} PWM_timer_state;
+
+static PWM_timer_state pwm_timer_state[PWM_TIM4 + 1];
+static uint8_t pwm_timers_reserved = PWM_RESERVED_TIMERS;   // Timers excluded from PWM use (bit n = PWM_TIMn)
+static uint16_t pwm_burst_rptcr[PWM_BURST_MAX_COUNT];       // Repetition counter values of bursts 3 ... n streamed by DMA (TIM1 only)
+static uint16_t pwm_pins_used[4];                           // Claimed pins per GPIO port (A - D)
+
+static void update_pwm_irq(uint8_t iTimer);
+static void end_pwm_burst(uint8_t iTimer);
+static void end_pwm_cascade(uint8_t iTimer);
+static void set_pwm_dither(PWM_handle *object, uint32_t duty);
+static int setup_pwm_channel(PWM_handle *object, uint8_t iTimer, uint8_t iChannel, uint16_t u16Pin, uint32_t remap, uint32_t iF_base, uint16_t iCount, uint16_t iPwm_mode, const PWM_timebase *tb, uint8_t restart, uint8_t rescale);
+
+#if !defined(CH32X035) && !defined(CH32X033)
+// Default pins (no remap) of timer channels, [timer][channel - 1], used for automatic placement
+static const uint16_t pwm_default_pins[PWM_TIM4 + 1][4] =
+{
+    { 0, 0, 0, 0 },
+    { 0x0A08, 0x0A09, 0x0A0A, 0x0A0B },     // TIM1: PA8, PA9, PA10, PA11
+    { 0x0A00, 0x0A01, 0x0A02, 0x0A03 },     // TIM2: PA0, PA1, PA2, PA3
+    { 0x0A06, 0x0A07, 0x0B00, 0x0B01 },     // TIM3: PA6, PA7, PB0, PB1
+    { 0x0B06, 0x0B07, 0x0B08, 0x0B09 },     // TIM4: PB6, PB7, PB8, PB9
+};
+// Order in which init_pwm_any() tries timers, general purpose timers first to keep TIM1 for complementary outputs
+static const uint8_t pwm_placement_order[] = { PWM_TIM3, PWM_TIM4, PWM_TIM2, PWM_TIM1 };
+#endif
+
+#if !defined(CH32X035) && !defined(CH32X033)
+// Internal trigger (ITRx) of a slave timer connected to TRGO of a master timer, [slave][master], 0xFFFF = no connection
+static const uint16_t pwm_itr_table[PWM_TIM4 + 1][PWM_TIM4 + 1] =
+{
+    { 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF },
+    { 0xFFFF, 0xFFFF, TIM_TS_ITR1, TIM_TS_ITR2, TIM_TS_ITR3 },   // TIM1: ITR1 = TIM2, ITR2 = TIM3, ITR3 = TIM4
+    { 0xFFFF, TIM_TS_ITR0, 0xFFFF, TIM_TS_ITR2, TIM_TS_ITR3 },   // TIM2: ITR0 = TIM1, ITR2 = TIM3, ITR3 = TIM4
+    { 0xFFFF, TIM_TS_ITR0, TIM_TS_ITR1, 0xFFFF, TIM_TS_ITR3 },   // TIM3: ITR0 = TIM1, ITR1 = TIM2, ITR3 = TIM4
+    { 0xFFFF, TIM_TS_ITR0, TIM_TS_ITR1, TIM_TS_ITR2, 0xFFFF },   // TIM4: ITR0 = TIM1, ITR1 = TIM2, ITR2 = TIM3
+};
+#endif
+
+/*********************************************************************
+ * @fn      search_pwm_timebase
+ *
+ * @brief   Search two factors p * a of a number of clock cycles num / den with minimal relative error.
+ *          a is kept in a_min .. 65536, p in p_min .. 65536. Among pairs with equal error, the one with
+ *          the largest a wins. Runtime is bounded by PWM_SOLVER_MAX_STEPS steps of p plus at most 65536
+ *          steps of a, the search loop itself only uses additions, multiplications and compares.
+ * 
+ * @param   num         Numerator of target (e.g. timer clock in Hz)
+ * @param   den         Denominator of target (e.g. frequency in Hz)
+ * @param   p_min       Minimum p
+ * @param   a_min       Minimum a
+ * @param   p_out       Found p
+ * @param   a_out       Found a
+ *
+ * @return  PWM_OK on success, PWM_ERR_FREQ if no pair is in range
+ */
+static int search_pwm_timebase(uint64_t num, uint64_t den, uint32_t p_min, uint32_t a_min, uint32_t *p_out, uint32_t *a_out)
+{
+    if (den == 0) return PWM_ERR_FREQ;
+    uint64_t n_target = num / den;                                      // Ideal p * a, rounded down
+    if (n_target < (uint64_t)p_min * a_min) return PWM_ERR_FREQ;        // Too fast for requested resolution
+
+    // ---------- Search window for p ----------
+    uint64_t p_lo = n_target >> 16;                                     // Below this, a would exceed 16 bit
+    if (p_lo < p_min) p_lo = p_min;
+    uint64_t p_hi = n_target / a_min + 1;                               // Above this, a would fall below a_min
+    if (p_hi > 65536) p_hi = 65536;
+    if (p_lo > p_hi) return PWM_ERR_FREQ;
+    if (p_hi - p_lo > PWM_SOLVER_MAX_STEPS) p_hi = p_lo + PWM_SOLVER_MAX_STEPS;
+
+    // ---------- Walk p upwards while tracking a = floor(num / (den * p)) downwards ----------
+    uint64_t a = n_target / p_lo + 1;
+    if (a > 65536) a = 65536;
+    if (a < a_min) a = a_min;
+    uint64_t fp = den * p_lo;                                           // den * p
+    uint64_t prod = fp * a;                                             // den * p * a
+    uint64_t best_err = 0, best_n = 1;
+    uint32_t best_p = 0, best_a = 0;
+    for (uint32_t p = (uint32_t)p_lo; p <= p_hi; p++)
+    {
+        while (a > a_min && prod > num)
+        {
+            a--;
+            prod -= fp;
+        }
+        // Candidates a and a + 1 enclose the ideal period for this p
+        for (uint32_t k = 0; k < 2; k++)
+        {
+            uint32_t ak = (uint32_t)a + k;
+            uint64_t pk = prod + (k ? fp : 0);
+            if (ak > 65536) break;
+            uint64_t err = (pk > num) ? (pk - num) : (num - pk);        // |num - den * n|, relative error is err / n
+            uint64_t n = (uint64_t)p * ak;
+            if (best_p == 0 || err * best_n < best_err * n)
+            {
+                best_err = err;
+                best_n = n;
+                best_p = p;
+                best_a = ak;
+            }
+        }
+        if (best_err == 0) break;                                       // Exact hit, can't do better
+        fp += den;
+        prod += den * a;
+    }
+    if (best_p == 0) return PWM_ERR_FREQ;
+    *p_out = best_p;
+    *a_out = best_a;
+    return PWM_OK;
+}
+
+/*********************************************************************
+ * @fn      solve_pwm_timebase
+ *
+ * @brief   Search the (PSC, ARR) space for the pair that hits a frequency with minimal error.
+ *          The timer period is (PSC + 1) * (ARR + 1) clock cycles, ARR is kept >= min_count.
+ *          Among pairs with equal error, the one with the highest resolution (largest ARR) wins.
+ *          Runtime is bounded by PWM_SOLVER_MAX_STEPS prescaler steps plus at most 65536 ARR steps.
+ * 
+ * @param   tb          Pointer to PWM_timebase struct to store result in
+ * @param   f_clk       Timer input clock in Hz (e.g. SystemCoreClock)
+ * @param   iF_base     Requested frequency in Hz
+ * @param   min_count   Minimum ARR value (e.g. 254 for at least 8-Bit resolution)
+ *
+ * @return  PWM_OK on success, PWM_ERR_FREQ if frequency is not reachable
+ */
+int solve_pwm_timebase(PWM_timebase *tb, uint32_t f_clk, uint32_t iF_base, uint16_t min_count)
+{
+    uint32_t p, a;
+    if (search_pwm_timebase(f_clk, iF_base, 1, (uint32_t)min_count + 1, &p, &a) != PWM_OK) return PWM_ERR_FREQ;
+    tb->prescaler = p - 1;
+    tb->arr = a - 1;
+    eval_pwm_timebase(tb, f_clk, iF_base);
+    return PWM_OK;
+}
+
+/*********************************************************************
+ * @fn      eval_pwm_timebase
+ *
+ * @brief   Calculate achieved frequency and error of a prescaler/period pair
+ * 
+ * @param   tb          Pointer to PWM_timebase struct with prescaler and arr set, f_actual and f_error_ppm are filled in
+ * @param   f_clk       Timer input clock in Hz (e.g. SystemCoreClock)
+ * @param   iF_base     Requested frequency in Hz (0 = unknown, error is reported as 0)
+ *
+ * @return  None
+ */
+void eval_pwm_timebase(PWM_timebase *tb, uint32_t f_clk, uint32_t iF_base)
+{
+    uint64_t n = ((uint64_t)tb->prescaler + 1) * ((uint64_t)tb->arr + 1);
+    tb->f_actual = (uint32_t)((f_clk + (n >> 1)) / n);
+    tb->f_error_ppm = (iF_base == 0) ? 0 : (int32_t)(((int64_t)f_clk - (int64_t)iF_base * (int64_t)n) * 1000000LL / ((int64_t)iF_base * (int64_t)n));
+}
+
+/*********************************************************************
+ * @fn      calc_pwm_max_counts
+ *
+ * @brief   Calculate the largest number of counts per period a frequency allows, using the smallest
+ *          prescaler that keeps the counts within a_limit
+ * 
+ * @param   f_clk       Timer input clock in Hz
+ * @param   iF_base     Requested frequency in Hz
+ * @param   a_limit     Maximum counts per period (65536, 65535 for center-aligned timers)
+ *
+ * @return  Counts per period (ARR + 1), 0 if below 2
+ */
+static uint32_t calc_pwm_max_counts(uint32_t f_clk, uint32_t iF_base, uint32_t a_limit)
+{
+    if (iF_base == 0) return 0;
+    uint32_t n = f_clk / iF_base;
+    uint32_t a = n / ((n + a_limit - 1) / a_limit + (n == 0));
+    return (a < 2) ? 0 : a;
+}
+
+/*********************************************************************
+ * @fn      plan_pwm_timebase
+ *
+ * @brief   Trade resolution against frequency: find the highest duty cycle resolution in bits a
+ *          frequency allows (at most 16) and the most accurate prescaler/period pair keeping it.
+ *          E.g. 20kHz from 144MHz gives 12 Bit (7200 counts), 1MHz gives 7 Bit (144 counts).
+ * 
+ * @param   tb          Pointer to PWM_timebase struct to store result in (ARR >= 2^bits - 1)
+ * @param   f_clk       Timer input clock in Hz (e.g. SystemCoreClock)
+ * @param   iF_base     Requested frequency in Hz
+ * @param   min_bits    Minimum acceptable resolution in bits (1 - 16)
+ *
+ * @return  Achievable resolution in bits (min_bits - 16), PWM_ERR_RANGE if min_bits is invalid,
+ *          PWM_ERR_FREQ if the frequency is not reachable with min_bits
+ */
+int plan_pwm_timebase(PWM_timebase *tb, uint32_t f_clk, uint32_t iF_base, uint8_t min_bits)
+{
+    if (min_bits == 0 || min_bits > 16) return PWM_ERR_RANGE;
+    uint32_t a_max = calc_pwm_max_counts(f_clk, iF_base, 65536);
+    uint8_t bits = 0;
+    while (bits < 16 && (2UL << bits) <= a_max) bits++;
+    if (bits < min_bits) return PWM_ERR_FREQ;
+    if (solve_pwm_timebase(tb, f_clk, iF_base, (uint16_t)((1UL << bits) - 1)) != PWM_OK) return PWM_ERR_FREQ;
+    return bits;
+}
+
+/*********************************************************************
+ * @fn      calc_pwm_duty_scale
+ *
+ * @brief   Calculate Q16 factor mapping duty cycle scale (0 .. period + 1) to timer counts (0 .. arr + 1)
+ * 
+ * @param   arr         Period of timer
+ * @param   period      Duty cycle scale of handle
+ *
+ * @return  Q16 scale factor
+ */
+static uint32_t calc_pwm_duty_scale(uint16_t arr, uint16_t period)
+{
+    return (uint32_t)((((uint64_t)arr + 1) << 16) / ((uint32_t)period + 1));
+}
+
+/*********************************************************************
+ * @fn      calc_pwm_millihz
+ *
+ * @brief   Calculate a frequency in mHz from f_clk * 1000 * den / periods, rounded
+ * 
+ * @param   num         f_clk * 1000 * den
+ * @param   periods     Timer clock cycles of den periods
+ *
+ * @return  Frequency in mHz, 0xFFFFFFFF if above 4.29MHz
+ */
+static uint32_t calc_pwm_millihz(uint64_t num, uint64_t periods)
+{
+    uint64_t f = (num + (periods >> 1)) / periods;
+    return (f > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)f;
+}
+
+/*********************************************************************
+ * @fn      get_pwm_clock
+ *
+ * @brief   Get the clock a timer's period is counted in, period = (PSC + 1) * (ARR + 1) / clock.
+ *          Center-aligned timers count up and down, so a period of arr + 1 counts takes twice as long,
+ *          which equals counting at half the clock.
+ * 
+ * @param   iTimer      Timer (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ *
+ * @return  Effective clock in Hz
+ */
+uint32_t get_pwm_clock(uint8_t iTimer)
+{
+    return SystemCoreClock >> pwm_timer_state[iTimer].center;
+}
+
+/*********************************************************************
+ * @fn      get_pwm_updates
+ *
+ * @brief   Get the number of update events (compare preload, update DMA request) per period of a timer
+ * 
+ * @param   iTimer      Timer (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ *
+ * @return  2 for center-aligned timers updating at top and bottom, else 1
+ */
+uint8_t get_pwm_updates(uint8_t iTimer)
+{
+    PWM_timer_state *state = &pwm_timer_state[iTimer];
+    return (state->center && state->update_mode == PWM_UPDATE_BOTH) ? 2 : 1;
+}
+
+/*********************************************************************
+ * @fn      solve_pwm_timer
+ *
+ * @brief   Solve the time base of a timer for its counting mode (see solve_pwm_timebase())
+ * 
+ * @param   tb          Pointer to PWM_timebase struct to store result in
+ * @param   center      1 if center-aligned
+ * @param   iF_base     Requested frequency in Hz
+ * @param   min_count   Minimum arr value
+ *
+ * @return  PWM_OK on success, PWM_ERR_FREQ if frequency is not reachable
+ */
+static int solve_pwm_timer(PWM_timebase *tb, uint8_t center, uint32_t iF_base, uint16_t min_count)
+{
+    if (solve_pwm_timebase(tb, SystemCoreClock >> center, iF_base, min_count) != PWM_OK) return PWM_ERR_FREQ;
+    if (center && tb->arr == 0xFFFF)
+    {
+        // ATRLR = arr + 1 has to fit 16 Bit, same period with doubled prescaler
+        if (tb->prescaler >= 0x8000 || min_count > 0x7FFF) return PWM_ERR_FREQ;
+        tb->prescaler = tb->prescaler * 2 + 1;
+        tb->arr = 0x7FFF;
+    }
+    return PWM_OK;
+}
+
+/*********************************************************************
+ * @fn      get_pwm_timer
+ *
+ * @brief   Resolve timer number to its register block
+ * 
+ * @param   iTimer      Timer (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ *
+ * @return  Pointer to timer registers, NULL if timer not available on this MCU
+ */
+TIM_TypeDef *get_pwm_timer(uint8_t iTimer)
+{
+    switch (iTimer)
+    {
+        case PWM_TIM1:
+            return TIM1;
+        case PWM_TIM2:
+            return TIM2;
+        case PWM_TIM3:
+            return TIM3;
+        #if !defined(CH32X035) && !defined(CH32X033)
+        case PWM_TIM4:
+            return TIM4;
+        #endif
+    }
+    return NULL;
+}
+
+/*********************************************************************
+ * @fn      get_pwm_ccr
+ *
+ * @brief   Resolve compare register of a timer channel
+ * 
+ * @param   tim         Pointer to timer registers
+ * @param   iChannel    Channel of timer (PWM_CH1, PWM_CH2, PWM_CH3 or PWM_CH4)
+ *
+ * @return  Pointer to compare register, NULL if invalid channel
+ */
+static __IO uint16_t *get_pwm_ccr(TIM_TypeDef *tim, uint8_t iChannel)
+{
+    switch (iChannel)
+    {
+        case PWM_CH1:
+            return &tim->CH1CVR;
+        case PWM_CH2:
+            return &tim->CH2CVR;
+        case PWM_CH3:
+            return &tim->CH3CVR;
+        case PWM_CH4:
+            return &tim->CH4CVR;
+    }
+    return NULL;
+}
+
+/*********************************************************************
+ * @fn      is_pwm_pin_used
+ *
+ * @brief   Check if a pin is claimed by the library
+ * 
+ * @param   u16Pin      Pin (e.g 0x0A08 for PA8 ...)
+ *
+ * @return  1 if pin in use (or invalid), else 0
+ */
+static uint8_t is_pwm_pin_used(uint16_t u16Pin)
+{
+    if (u16Pin < 0x0a00 || u16Pin > 0x0dff || (u16Pin & 0xff) > 15) return 1;
+    return (pwm_pins_used[((u16Pin >> 8) & 0x0f) - 0x0a] >> (u16Pin & 0x0f)) & 1;
+}
+
+/*********************************************************************
+ * @fn      claim_pwm_pin
+ *
+ * @brief   Mark a pin as used by the library
+ * 
+ * @param   u16Pin      Pin (e.g 0x0A08 for PA8 ...)
+ *
+ * @return  PWM_OK on success, PWM_ERR_PIN if invalid pin specified, PWM_ERR_BUSY if pin already in use
+ */
+static int claim_pwm_pin(uint16_t u16Pin)
+{
+    if (u16Pin < 0x0a00 || u16Pin > 0x0dff || (u16Pin & 0xff) > 15) return PWM_ERR_PIN;
+    if (is_pwm_pin_used(u16Pin)) return PWM_ERR_BUSY;
+    pwm_pins_used[((u16Pin >> 8) & 0x0f) - 0x0a] |= 1 << (u16Pin & 0x0f);
+    return PWM_OK;
+}
+
+/*********************************************************************
+ * @fn      release_pwm_pin
+ *
+ * @brief   Mark a pin as no longer used by the library
+ * 
+ * @param   u16Pin      Pin (e.g 0x0A08 for PA8 ...), invalid pins are ignored
+ *
+ * @return  None
+ */
+static void release_pwm_pin(uint16_t u16Pin)
+{
+    if (u16Pin < 0x0a00 || u16Pin > 0x0dff || (u16Pin & 0xff) > 15) return;
+    pwm_pins_used[((u16Pin >> 8) & 0x0f) - 0x0a] &= (uint16_t)~(1 << (u16Pin & 0x0f));
+}
+
+/*********************************************************************
+ * @fn      release_pwm
+ *
+ * @brief   Release timer channel and pins of a PWM object, so they can be used by another handle.
+ *          The hardware keeps running, call disable_pwm_output() first to stop the output.
+ *          Does nothing if the object is not registered.
+ * 
+ * @param   object      Pointer to PWM_handle struct to release
+ *
+ * @return  None
+ */
+void release_pwm(PWM_handle *object)
+{
+    for (uint8_t t = PWM_TIM1; t <= PWM_TIM4; t++)
+    {
+        for (uint8_t i = 0; i < 4; i++)
+        {
+            if (pwm_timer_state[t].channels[i] == object)
+            {
+                disable_pwm_dither(object);                     // Fields are only valid for registered handles
+                pwm_timer_state[t].channels[i] = NULL;
+                release_pwm_pin(object->pin);
+                release_pwm_pin(object->pin_n);
+            }
+        }
+    }
+}
+
+/*********************************************************************
+ * @fn      rescale_pwm_channels
+ *
+ * @brief   Move all channels of a timer to a new time base, keeping their duty ratios (dithered
+ *          channels including the fraction of a count). Only updates handles and compare registers,
+ *          the timer registers are left to the caller.
+ * 
+ * @param   iTimer      Timer (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ * @param   tb          New time base of the timer
+ * @param   skip        Handle to leave untouched (NULL for none)
+ *
+ * @return  None
+ */
+static void rescale_pwm_channels(uint8_t iTimer, const PWM_timebase *tb, PWM_handle *skip)
+{
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        PWM_handle *h = pwm_timer_state[iTimer].channels[i];
+        if (h == NULL || h == skip) continue;
+        PWM_timebase own = *tb;
+        uint32_t old_len = (uint32_t)h->arr + 1;
+        uint32_t counts = old_len - h->duty_cycle;                       // Active counts per period
+        uint32_t dither = 0;
+        if (h->dither_bits)
+        {
+            // Duty cycle in Q16 including the dithered fraction, applied again to the new period below
+            uint64_t q = (((uint64_t)counts << h->dither_bits) + h->dither_frac) << (16 - h->dither_bits);
+            dither = (uint32_t)((q + (old_len >> 1)) / old_len);
+        }
+        counts = (uint32_t)(((uint64_t)counts * ((uint32_t)tb->arr + 1) + (old_len >> 1)) / old_len);
+        eval_pwm_timebase(&own, get_pwm_clock(iTimer), h->f_base);
+        h->prescaler = tb->prescaler;
+        h->arr = tb->arr;
+        h->duty_scale = calc_pwm_duty_scale(tb->arr, h->period);
+        h->f_actual = own.f_actual;
+        h->f_error_ppm = own.f_error_ppm;
+        h->f_avg_millihz = calc_pwm_millihz((uint64_t)get_pwm_clock(iTimer) * 1000, ((uint64_t)tb->prescaler + 1) * ((uint64_t)tb->arr + 1));
+        h->jitter_ps = 0;
+        h->duty_cycle = (uint16_t)(tb->arr + 1 - counts);
+        *h->ccr = h->duty_cycle;
+        if (h->dither_bits) set_pwm_dither(h, dither);          // Fraction of a count differs in the new period
+    }
+}
+
+/*********************************************************************
+ * @fn      set_pwm_freq_policy
+ *
+ * @brief   Select how a timer handles a new channel requesting a frequency the timer can't
+ *          serve as well as a dedicated timer could. PWM_FREQ_REJECT lets init_pwm() fail with
+ *          PWM_ERR_CONFLICT, PWM_FREQ_RESCALE retunes the timer and rescales the compare values
+ *          of existing channels so their duty ratios are kept. Default is PWM_FREQ_POLICY.
+ * 
+ * @param   iTimer      Timer (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ * @param   policy      PWM_FREQ_REJECT or PWM_FREQ_RESCALE
+ *
+ * @return  None
+ */
+void set_pwm_freq_policy(uint8_t iTimer, uint8_t policy)
+{
+    if (get_pwm_timer(iTimer) == NULL) return;
+    pwm_timer_state[iTimer].freq_policy = policy;
+}
+
+/*********************************************************************
+ * @fn      reserve_pwm_timer
+ *
+ * @brief   Exclude a timer from PWM use, e.g. because another library reprograms it
+ *          (CH32V USB Serial Library uses TIM2 for its tick). Initializing a PWM channel
+ *          on a reserved timer fails with PWM_ERR_BUSY.
+ * 
+ * @param   iTimer      Timer (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ *
+ * @return  PWM_OK on success, PWM_ERR_TIMER if invalid timer, PWM_ERR_BUSY if PWM channels or an input measurement already use the timer
+ */
+int reserve_pwm_timer(uint8_t iTimer)
+{
+    if (get_pwm_timer(iTimer) == NULL) return PWM_ERR_TIMER;
+    if (pwm_timer_state[iTimer].capture) return PWM_ERR_BUSY;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        if (pwm_timer_state[iTimer].channels[i]) return PWM_ERR_BUSY;
+    }
+    pwm_timers_reserved |= 1 << iTimer;
+    return PWM_OK;
+}
+
+/*********************************************************************
+ * @fn      init_pwm_gpio
+ *
+ * @brief   Configure pin for a timer channel
+ * 
+ * @param   u16Pin      Pin (e.g 0x0A08 for PA8 ...)
+ * @param   mode        Pin mode (GPIO_Mode_AF_PP for outputs, GPIO_Mode_IN_FLOATING for inputs)
+ *
+ * @return  PWM_OK on success, PWM_ERR_PIN if invalid pin specified
+ */
+static int init_pwm_gpio(uint16_t u16Pin, GPIOMode_TypeDef mode)
+{
+    GPIO_InitTypeDef GPIO_InitStructure={0};
+
+    if (u16Pin < 0x0a00 || u16Pin > 0x0dff) return PWM_ERR_PIN; // invalid pin number
+    // based on pinMode() https://gist.github.com/bitbank2/13686b8a153a0b3a06839f4fa00589cb
+    GPIO_InitStructure.GPIO_Pin = GPIO_Pin_0 << (u16Pin & 0xff);
+    GPIO_InitStructure.GPIO_Mode = mode;
+    GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
+    switch (u16Pin & 0x0f00)
+    {
+        case 0x0a00:
+            RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOA, ENABLE);
+            GPIO_Init(GPIOA, &GPIO_InitStructure);
+            break;
+        case 0x0b00:
+            RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOB, ENABLE);
+            GPIO_Init(GPIOB, &GPIO_InitStructure);
+            break;
+        case 0x0c00:
+            RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOC, ENABLE);
+            GPIO_Init(GPIOC, &GPIO_InitStructure);
+            break;
+        #if !defined(CH32X035) && !defined(CH32X033)
+        case 0x0d00:
+            RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOD, ENABLE);
+            GPIO_Init(GPIOD, &GPIO_InitStructure);
+            break;
+        #endif
+    }
+    return PWM_OK;
+}
+
+/*********************************************************************
+ * @fn      enable_pwm_timer_clock
+ *
+ * @brief   Enable the peripheral clock of a timer
+ * 
+ * @param   iTimer      Timer (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ *
+ * @return  None
+ */
+static void enable_pwm_timer_clock(uint8_t iTimer)
+{
+    switch (iTimer)
+    {
+        case PWM_TIM1:
+            RCC_APB2PeriphClockCmd(RCC_APB2Periph_TIM1, ENABLE);
+            break;
+        case PWM_TIM2:
+            RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2 , ENABLE);
+            break;
+        case PWM_TIM3:
+            RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM3 , ENABLE);
+            break;
+        #if !defined(CH32X035) && !defined(CH32X033)
+        case PWM_TIM4:
+            RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM4 , ENABLE);
+            break;
+        #endif
+    }
+}
+
+/*********************************************************************
+ * @fn      init_pwm_timebase
+ *
+ * @brief   Program prescaler, period and counting mode of a timer from its state and restart the count.
+ *          The counter is left stopped, TIM_Cmd() starts it.
+ * 
+ * @param   iTimer      Timer (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ *
+ * @return  None
+ */
+static void init_pwm_timebase(uint8_t iTimer)
+{
+    TIM_TypeDef *tim = get_pwm_timer(iTimer);
+    PWM_timer_state *state = &pwm_timer_state[iTimer];
+    TIM_TimeBaseInitTypeDef TIM_TimeBaseInitStructure={0};
+    tim->CTLR1 &= (uint16_t)~TIM_CEN;                         // Counting mode may only change while the counter is stopped
+    TIM_TimeBaseInitStructure.TIM_Period = state->arr + state->center;
+    TIM_TimeBaseInitStructure.TIM_Prescaler = state->prescaler;
+    TIM_TimeBaseInitStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+    TIM_TimeBaseInitStructure.TIM_CounterMode = (uint16_t)state->counter_mode << 5;    // CMS bits (TIM_CounterMode_Up, TIM_CounterMode_CenterAlignedx)
+    TIM_TimeBaseInitStructure.TIM_RepetitionCounter = (state->update_mode == PWM_UPDATE_TOP) ? 1 : 0;  // Written before start: update at overflow
+    TIM_TimeBaseInit(tim, &TIM_TimeBaseInitStructure);
+    TIM_SelectOutputTrigger(tim, TIM_TRGOSource_Update);       // Enable self-resetting TRGO-Event when no PWM configured
+}
+
+/*********************************************************************
+ * @fn      set_pwm_counter_mode
+ *
+ * @brief   Select edge-aligned or center-aligned counting of a timer. Center-aligned timers count
+ *          up to ARR and back down, so pulses of all channels are centered in the period (symmetric
+ *          switching, e.g. for sampling motor currents in the middle of the pulse). The frequency solver
+ *          compensates the doubled count, so the frequency of the timer's channels is kept and their
+ *          duty ratios are rescaled. Update events (compare preload, update interrupt, DMA) happen at
+ *          top and bottom of the count, e.g. to run a control loop at twice the PWM rate, or on TIM1
+ *          only at the top or bottom by its repetition counter.
+ *          Can be called before or after initializing the timer's channels, stops frequency dithering.
+ * 
+ * @param   iTimer      Timer (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ * @param   mode        PWM_COUNT_UP, PWM_COUNT_CENTER1, PWM_COUNT_CENTER2 or PWM_COUNT_CENTER3
+ * @param   update      PWM_UPDATE_BOTH, PWM_UPDATE_TOP or PWM_UPDATE_BOTTOM (ignored for PWM_COUNT_UP)
+ *
+ * @return  PWM_OK on success, PWM_ERR_TIMER if invalid timer, PWM_ERR_RANGE if mode or update is invalid
+ *          (PWM_UPDATE_TOP/BOTTOM need TIM1), PWM_ERR_FREQ if the frequency of the channels is not reachable,
+ *          PWM_ERR_BUSY if the timer is cascaded (see init_pwm_cascade()) or a DMA stream writes its registers
+ */
+int set_pwm_counter_mode(uint8_t iTimer, uint8_t mode, uint8_t update)
+{
+    TIM_TypeDef *tim = get_pwm_timer(iTimer);
+    if (tim == NULL) return PWM_ERR_TIMER;
+    if (mode > PWM_COUNT_CENTER3 || update > PWM_UPDATE_BOTTOM) return PWM_ERR_RANGE;
+    if (pwm_timer_state[iTimer].master) return PWM_ERR_BUSY;     // Cascaded timers count master periods
+    if (is_pwm_stream_active(iTimer)) return PWM_ERR_BUSY;      // Streamed values are computed for the current period
+    if (mode == PWM_COUNT_UP) update = PWM_UPDATE_BOTH;
+    if (update != PWM_UPDATE_BOTH && iTimer != PWM_TIM1) return PWM_ERR_RANGE;     // Only TIM1 has a repetition counter
+    PWM_timer_state *state = &pwm_timer_state[iTimer];
+    uint16_t min_count = 0;
+    uint8_t used = 0;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        PWM_handle *h = state->channels[i];
+        if (h == NULL) continue;
+        used = 1;
+        if (h->period > min_count) min_count = h->period;
+    }
+    PWM_timebase tb;
+    if (used && solve_pwm_timer(&tb, mode != PWM_COUNT_UP, state->f_base, min_count) != PWM_OK) return PWM_ERR_FREQ;
+    disable_pwm_freq_dither(iTimer);
+    state->counter_mode = mode;
+    state->update_mode = update;
+    state->center = (mode != PWM_COUNT_UP);
+    if (!used) return PWM_OK;                                   // Applied when the first channel is initialized
+
+    // ---------- Move running channels to the new time base ----------
+    rescale_pwm_channels(iTimer, &tb, NULL);
+    state->prescaler = tb.prescaler;
+    state->arr = tb.arr;
+    init_pwm_timebase(iTimer);
+    TIM_Cmd(tim, ENABLE);
+    if (update == PWM_UPDATE_BOTTOM) tim->RPTCR = 1;            // Written after start: update at underflow
+    return PWM_OK;
+}
+
+/*********************************************************************
+ * @fn      set_pwm_frequency
+ *
+ * @brief   Change the carrier frequency of a running timer without glitches, e.g. for tone generators
+ *          or frequency sweeps. Prescaler, period and the rescaled compare values of all channels are
+ *          written to their shadow registers while update events are held back (UDIS), so the new
+ *          period starts complete at the next update event and the duty ratios are kept. The prescaler
+ *          is kept if the new period fits it with the resolution of the channels (only ATRLR changes),
+ *          otherwise the time base is solved like in init_pwm(). Compare register preload is enabled
+ *          on all channels of the timer and stays enabled afterwards, later duty cycle changes take
+ *          effect at the next update event (see set_pwm_preload() to return to immediate updates).
+ *          Nothing is reinitialized, the counter keeps running. Stops frequency dithering.
+ * 
+ * @param   iTimer      Timer (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ * @param   iF_base     New carrier frequency in Hz, the achieved frequency is stored in f_actual of all handles
+ *
+ * @return  PWM_OK on success, PWM_ERR_TIMER if invalid timer or no channel is initialized on it,
+ *          PWM_ERR_FREQ if the frequency is not reachable with the resolution of the channels,
+ *          PWM_ERR_BUSY if the timer is cascaded or a DMA stream writes its registers
+ */
+int set_pwm_frequency(uint8_t iTimer, uint32_t iF_base)
+{
+    TIM_TypeDef *tim = get_pwm_timer(iTimer);
+    if (tim == NULL) return PWM_ERR_TIMER;
+    PWM_timer_state *state = &pwm_timer_state[iTimer];
+    uint16_t min_count = 0;
+    uint8_t used = 0;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        PWM_handle *h = state->channels[i];
+        if (h == NULL) continue;
+        used = 1;
+        if (h->period > min_count) min_count = h->period;
+    }
+    if (!used) return PWM_ERR_TIMER;
+    if (state->master || is_pwm_stream_active(iTimer)) return PWM_ERR_BUSY;
+    if (iF_base == 0) return PWM_ERR_FREQ;
+
+    // ---------- Keep prescaler if its period still fits, else solve the time base ----------
+    PWM_timebase tb = { state->prescaler, 0, 0, 0 };
+    uint64_t div = ((uint64_t)state->prescaler + 1) * iF_base;
+    uint64_t counts = ((uint64_t)get_pwm_clock(iTimer) + (div >> 1)) / div;
+    if (counts > min_count && counts <= (uint64_t)0x10000 - state->center)
+    {
+        tb.arr = (uint16_t)(counts - 1);
+    }
+    else if (solve_pwm_timer(&tb, state->center, iF_base, min_count) != PWM_OK)
+    {
+        return PWM_ERR_FREQ;
+    }
+    disable_pwm_freq_dither(iTimer);
+
+    // ---------- Write shadow registers, next update event transfers all values ----------
+    tim->CTLR1 |= TIM_UDIS;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        PWM_handle *h = state->channels[i];
+        if (h == NULL) continue;
+        if (!h->preload) set_pwm_preload(h, ENABLE);
+        h->f_base = iF_base;
+        h->update_pending = 1;
+    }
+    rescale_pwm_channels(iTimer, &tb, NULL);
+    tim->PSC = tb.prescaler;
+    tim->ATRLR = tb.arr + state->center;
+    state->f_base = iF_base;
+    state->prescaler = tb.prescaler;
+    state->arr = tb.arr;
+    if (!(tim->DMAINTENR & TIM_UIE)) tim->INTFR = (uint16_t)~TIM_UIF;     // Detect the update event by polling
+    tim->CTLR1 &= (uint16_t)~TIM_UDIS;
+    return PWM_OK;
+}
+
+/*********************************************************************
+ * @fn      init_pwm_channel
+ *
+ * @brief   Initialize handler for PWM structure. This makes a pin ready for PWM output.
+ *          The output channel is configured once here and starts with 0% duty cycle.
+ * 
+ * @param   object      Pointer to PWM_handle struct to initialize
+ * @param   iTimer      Timer to use for PWM (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ * @param   iChannel    Channel of time to use for PWM (PWM_CH1, PWM_CH2, PWM_CH3 or PWM_CH4)
+ * @param   u16Pin      Pin for outputting PWM signal (e.g 0x0A08 for PA8 ...)
+ * @param   remap       AFIO remap bits required by the pin, see PWM_REMAP() (0 = leave AFIO untouched)
+ * @param   iF_base     Base carrier frequency of PWM signal (e.g. 10000 = 10kHz) 
+ *                      The achieved frequency and its error are stored in object->f_actual and object->f_error_ppm.
+ * @param   iCount      Base for scaling duty cycle (max = iCount + 1, min = 0) (e.g. 254 for 8-Bit resolution)
+ *                      The timer period (object->arr) may be longer than iCount to match the frequency more closely.
+ *                      PWM_RESOLUTION_MAX uses the longest timer period the frequency allows, object->period tells the scale.
+ * @param   iPwm_mode   PWM mode selection, changes precision of actual output (PWM_MODE1 or PWM_MODE2)
+ *
+ * @return  PWM_OK on success, PWM_ERR_PIN if invalid pin specified, PWM_ERR_FREQ if frequency is not reachable,
+ *          PWM_ERR_TIMER if invalid timer or channel specified, PWM_ERR_BUSY if timer, channel or pin already in use
+ *          or if retuning the timer is needed while a DMA stream or frequency dithering drives it,
+ *          PWM_ERR_CONFLICT if other channels on the timer run at an incompatible frequency
+ */
+static int init_pwm_channel(PWM_handle *object, uint8_t iTimer, uint8_t iChannel, uint16_t u16Pin, uint32_t remap, uint32_t iF_base, uint16_t iCount, uint16_t iPwm_mode)
+{   
+    // --------- Check arguments ----------
+    PWM_timebase tb;
+    TIM_TypeDef *tim = get_pwm_timer(iTimer);
+    if (tim == NULL || get_pwm_ccr(tim, iChannel) == NULL) return PWM_ERR_TIMER;
+    if (u16Pin < 0x0a00 || u16Pin > 0x0dff || (u16Pin & 0xff) > 15) return PWM_ERR_PIN; // invalid pin number
+    // ---------- Check for conflicts (re-initializing the same handle is allowed) ----------
+    PWM_handle *owner = pwm_timer_state[iTimer].channels[iChannel - 1];
+    if (pwm_timers_reserved & (1 << iTimer)) return PWM_ERR_BUSY;
+    if (owner != NULL && owner != object) return PWM_ERR_BUSY;
+    if (is_pwm_pin_used(u16Pin) && !(owner == object && object->pin == u16Pin)) return PWM_ERR_BUSY;
+    PWM_timer_state *state = &pwm_timer_state[iTimer];
+    if (iCount == PWM_RESOLUTION_MAX)
+    {
+        // Duty cycle scale = full timer period at the smallest prescaler
+        uint32_t a_max = calc_pwm_max_counts(get_pwm_clock(iTimer), iF_base, 65536 - state->center);   // ATRLR = arr + 1 when center-aligned
+        if (a_max == 0) return PWM_ERR_FREQ;
+        iCount = (uint16_t)(a_max - 1);
+    }
+    if (solve_pwm_timer(&tb, state->center, iF_base, iCount) != PWM_OK) return PWM_ERR_FREQ;
+
+    // ---------- Arbitrate frequency with other channels on this timer ----------
+    uint8_t restart = 1;                                        // Timer time base has to be (re-)initialized
+    uint8_t rescale = 0;                                        // Other channels have to follow a new time base
+    uint16_t min_count = iCount;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        PWM_handle *h = state->channels[i];
+        if (h == NULL || h == object) continue;
+        restart = 0;
+        if (h->period > min_count) min_count = h->period;
+        if ((h->remap >> 16) & (remap >> 16) & (h->remap ^ remap)) return PWM_ERR_BUSY;     // Remap moves pin of other channel
+    }
+    if (!restart)
+    {
+        PWM_timebase cur = { state->prescaler, state->arr, 0, 0 };
+        eval_pwm_timebase(&cur, get_pwm_clock(iTimer), iF_base);
+        uint32_t cur_err = (cur.f_error_ppm < 0) ? -cur.f_error_ppm : cur.f_error_ppm;
+        uint32_t new_err = (tb.f_error_ppm < 0) ? -tb.f_error_ppm : tb.f_error_ppm;
+        if (state->arr >= iCount && cur_err <= new_err)
+        {
+            tb = cur;                                           // Compatible, join running timer
+        }
+        else if ((state->freq_policy ? state->freq_policy : PWM_FREQ_POLICY) == PWM_FREQ_RESCALE)
+        {
+            // A DMA stream or frequency dithering writes the timer registers for the running period
+            if (is_pwm_stream_active(iTimer) || is_pwm_freq_dither_active(iTimer)) return PWM_ERR_BUSY;
+            if (solve_pwm_timer(&tb, state->center, iF_base, min_count) != PWM_OK) return PWM_ERR_FREQ;
+            restart = 1;
+            rescale = 1;
+        }
+        else
+        {
+            return PWM_ERR_CONFLICT;
+        }
+    }
+    if (state->master)
+    {
+        if (!restart) return PWM_ERR_CONFLICT;                  // Other channels run on the cascade
+        end_pwm_cascade(iTimer);
+    }
+    return setup_pwm_channel(object, iTimer, iChannel, u16Pin, remap, iF_base, iCount, iPwm_mode, &tb, restart, rescale);
+}
+
+/*********************************************************************
+ * @fn      setup_pwm_channel
+ *
+ * @brief   Register a channel with an arbitrated time base, configure its pin and output
+ *          and (re-)initialize the timer if needed.
+ * 
+ * @param   object      Pointer to PWM_handle struct to initialize
+ * @param   iTimer      Timer (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ * @param   iChannel    Channel of timer (PWM_CH1, PWM_CH2, PWM_CH3 or PWM_CH4)
+ * @param   u16Pin      Pin for outputting PWM signal (e.g 0x0A08 for PA8 ...)
+ * @param   remap       AFIO remap bits required by the pin, see PWM_REMAP() (0 = leave AFIO untouched)
+ * @param   iF_base     Base carrier frequency of PWM signal
+ * @param   iCount      Base for scaling duty cycle
+ * @param   iPwm_mode   PWM mode selection (PWM_MODE1 or PWM_MODE2)
+ * @param   tb          Time base of the timer
+ * @param   restart     Timer time base has to be (re-)initialized
+ * @param   rescale     Other channels have to follow the new time base
+ *
+ * @return  PWM_OK
+ */
+static int setup_pwm_channel(PWM_handle *object, uint8_t iTimer, uint8_t iChannel, uint16_t u16Pin, uint32_t remap, uint32_t iF_base, uint16_t iCount, uint16_t iPwm_mode, const PWM_timebase *tb, uint8_t restart, uint8_t rescale)
+{
+    TIM_TypeDef *tim = get_pwm_timer(iTimer);
+    PWM_timer_state *state = &pwm_timer_state[iTimer];
+    release_pwm(object);
+    claim_pwm_pin(u16Pin);
+    if (rescale) rescale_pwm_channels(iTimer, tb, object);
+
+    // --------- Set attributes ----------
+    object->pwm_mode = iPwm_mode;
+    object->timer = iTimer;
+    object->channel = iChannel;
+    object->period = iCount;
+    object->prescaler = tb->prescaler;
+    object->arr = tb->arr;
+    object->duty_scale = calc_pwm_duty_scale(tb->arr, iCount);
+    object->f_base = iF_base;
+    object->f_actual = tb->f_actual;
+    object->f_error_ppm = tb->f_error_ppm;
+    object->f_avg_millihz = calc_pwm_millihz((uint64_t)get_pwm_clock(iTimer) * 1000, ((uint64_t)tb->prescaler + 1) * ((uint64_t)tb->arr + 1));
+    object->jitter_ps = 0;
+    object->tim = tim;
+    object->ccr = get_pwm_ccr(tim, iChannel);
+    object->ccer_mask = TIM_CC1E << ((iChannel - 1) * 4);
+    object->duty_cycle = object->arr + 1;                       // Start with 0% duty cycle
+    object->preload = 0;
+    object->update_pending = 0;
+    object->break_count = 0;
+    object->break_timestamp = 0;
+    object->dither_bits = 0;
+    object->dither_table = NULL;
+    object->pin = u16Pin;
+    object->pin_n = 0;
+    object->remap = remap;
+    state->channels[iChannel - 1] = object;
+    state->f_base = iF_base;
+    state->prescaler = tb->prescaler;
+    state->arr = tb->arr;
+
+    // ---------- Initialize ----------
+    TIM_OCInitTypeDef TIM_OCInitStructure={0};
+
+    // ---------- Set Pin as output ---------
+    if (remap >> 16)
+    {
+        // Only touch the bits of this pin, SWCFG reads undefined and is written 0 like in GPIO_PinRemapConfig()
+        RCC_APB2PeriphClockCmd(RCC_APB2Periph_AFIO, ENABLE);
+        AFIO->PCFR1 = (AFIO->PCFR1 & ~((remap >> 16) | 0x0F000000)) | (remap & 0xFFFF);
+    }
+    init_pwm_gpio(u16Pin, GPIO_Mode_AF_PP);
+    // ---------- Initialize Timer ----------
+    enable_pwm_timer_clock(iTimer);
+    if (restart) init_pwm_timebase(iTimer);
+
+    // ---------- Configure Channel once, duty cycle updates only touch the compare register ----------
+    TIM_OCInitStructure.TIM_OCMode = (object->pwm_mode == PWM_MODE1) ? TIM_OCMode_PWM1 : TIM_OCMode_PWM2;
+    TIM_OCInitStructure.TIM_OutputState = TIM_OutputState_Enable;
+	TIM_OCInitStructure.TIM_Pulse = object->duty_cycle;
+	TIM_OCInitStructure.TIM_OCPolarity = TIM_OCPolarity_High;
+    switch (object->channel)
+    {
+        case PWM_CH1:
+            TIM_OC1Init(tim, &TIM_OCInitStructure);
+            TIM_OC1PreloadConfig(tim, TIM_OCPreload_Disable);
+            break;
+        case PWM_CH2:
+            TIM_OC2Init(tim, &TIM_OCInitStructure);
+            TIM_OC2PreloadConfig(tim, TIM_OCPreload_Disable);
+            break;
+        case PWM_CH3:
+            TIM_OC3Init(tim, &TIM_OCInitStructure);
+            TIM_OC3PreloadConfig(tim, TIM_OCPreload_Disable);
+            break;
+        case PWM_CH4:
+            TIM_OC4Init(tim, &TIM_OCInitStructure);
+            TIM_OC4PreloadConfig(tim, TIM_OCPreload_Disable);
+            break;
+    }
+    TIM_CtrlPWMOutputs(tim, ENABLE);
+    TIM_ARRPreloadConfig(tim, ENABLE);
+    TIM_Cmd(tim, ENABLE);
+    if (restart && state->update_mode == PWM_UPDATE_BOTTOM) tim->RPTCR = 1;    // Written after start: update at underflow
+    return PWM_OK;
+}
+
+/*********************************************************************
+ * @fn      init_pwm_base
+ *
+ * @brief   Initialize handler for PWM structure on a raw pin code. AFIO remapping is left to the user.
+ * 
+ * @param   object      Pointer to PWM_handle struct to initialize
+ * @param   iTimer      Timer to use for PWM (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ * @param   iChannel    Channel of time to use for PWM (PWM_CH1, PWM_CH2, PWM_CH3 or PWM_CH4)
+ * @param   u16Pin      Pin for outputting PWM signal (e.g 0x0A08 for PA8 ...)
+ * @param   iF_base     Base carrier frequency of PWM signal (e.g. 10000 = 10kHz) 
+ * @param   iCount      Base for scaling duty cycle (max = iCount + 1, min = 0) (e.g. 254 for 8-Bit resolution)
+ * @param   iPwm_mode   PWM mode selection, changes precision of actual output (PWM_MODE1 or PWM_MODE2)
+ *
+ * @return  See init_pwm_channel()
+ */
+int init_pwm_base(PWM_handle *object, uint8_t iTimer, uint8_t iChannel, uint16_t u16Pin, uint32_t iF_base, uint16_t iCount, uint16_t iPwm_mode)
+{
+    return init_pwm_channel(object, iTimer, iChannel, u16Pin, PWM_REMAP_NONE, iF_base, iCount, iPwm_mode);
+}
+
+/*********************************************************************
+ * @fn      end_pwm_cascade
+ *
+ * @brief   Return a cascaded timer to its internal clock, stop its master timer and release it for PWM use
+ * 
+ * @param   iTimer      Cascaded timer
+ *
+ * @return  None
+ */
+static void end_pwm_cascade(uint8_t iTimer)
+{
+    PWM_timer_state *state = &pwm_timer_state[iTimer];
+    if (state->master == 0) return;
+    get_pwm_timer(iTimer)->SMCFGR &= (uint16_t)~TIM_SMS;
+    get_pwm_timer(state->master)->CTLR1 &= (uint16_t)~TIM_CEN;
+    pwm_timers_reserved &= (uint8_t)~(1 << state->master);
+    state->master = 0;
+    state->f_millihz = 0;
+}
+
+/*********************************************************************
+ * @fn      init_pwm_cascade
+ *
+ * @brief   Initialize a PWM channel for very low frequencies (down to 1mHz) or very long periods.
+ *          A master timer divides the clock by up to 2^32 (prescaler and period) and clocks the
+ *          channel's timer by its update events (TRGO -> ITRx, external clock mode 1), giving up to
+ *          2^48 clock cycles per period. The channel's timer counts with the highest resolution the
+ *          frequency allows (up to 65536 steps), the master takes the rest of the division. The master
+ *          timer is reserved for the cascade (no PWM channels of its own) until the last channel of the
+ *          cascade is re-initialized on the internal clock.
+ *          Further channels of the same timer join with the same master and frequency.
+ *          Counting mode, frequency dithering and phase-aligned start are not available on cascaded timers,
+ *          start_pwm_pulses() on a cascaded TIM1 gives long one-shot delays (first period starts with the
+ *          next master update, up to one duty cycle step later).
+ * 
+ * @param   object      Pointer to PWM_handle struct to initialize
+ * @param   iMaster     Timer dividing the clock (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4, without channels)
+ * @param   iTimer      Timer to use for PWM (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ * @param   iChannel    Channel of timer to use for PWM (PWM_CH1, PWM_CH2, PWM_CH3 or PWM_CH4)
+ * @param   u16Pin      Pin for outputting PWM signal (e.g 0x0A08 for PA8 ...), AFIO remapping is left to the user
+ * @param   f_millihz   Carrier frequency in mHz (e.g. 10 = 0.01Hz), the achieved average is stored in
+ *                      object->f_avg_millihz, its error in object->f_error_ppm
+ * @param   iCount      Base for scaling duty cycle (max = iCount + 1, min = 0)
+ * @param   iPwm_mode   PWM mode selection (PWM_MODE1 or PWM_MODE2)
+ *
+ * @return  PWM_OK on success, PWM_ERR_PIN if invalid pin specified, PWM_ERR_FREQ if frequency is not reachable,
+ *          PWM_ERR_TIMER if invalid timers or channel or iTimer can't be clocked by iMaster (CH32X035),
+ *          PWM_ERR_BUSY if a timer, channel or pin is already in use, PWM_ERR_CONFLICT if other channels
+ *          on the timer run at a different frequency or on the internal clock
+ */
+int init_pwm_cascade(PWM_handle *object, uint8_t iMaster, uint8_t iTimer, uint8_t iChannel, uint16_t u16Pin, uint32_t f_millihz, uint16_t iCount, uint16_t iPwm_mode)
+{
+    #if defined(CH32X035) || defined(CH32X033)
+    return PWM_ERR_TIMER;
+    #else
+    // --------- Check arguments ----------
+    TIM_TypeDef *tim = get_pwm_timer(iTimer);
+    TIM_TypeDef *master = get_pwm_timer(iMaster);
+    if (tim == NULL || master == NULL || get_pwm_ccr(tim, iChannel) == NULL) return PWM_ERR_TIMER;
+    if (pwm_itr_table[iTimer][iMaster] == 0xFFFF) return PWM_ERR_TIMER;
+    if (u16Pin < 0x0a00 || u16Pin > 0x0dff || (u16Pin & 0xff) > 15) return PWM_ERR_PIN; // invalid pin number
+    PWM_timer_state *state = &pwm_timer_state[iTimer];
+    PWM_handle *owner = state->channels[iChannel - 1];
+    if (pwm_timers_reserved & (1 << iTimer)) return PWM_ERR_BUSY;
+    if (owner != NULL && owner != object) return PWM_ERR_BUSY;
+    if (is_pwm_pin_used(u16Pin) && !(owner == object && object->pin == u16Pin)) return PWM_ERR_BUSY;
+    uint8_t restart = 1;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        PWM_handle *h = state->channels[i];
+        if (h != NULL && h != object) restart = 0;
+    }
+    if (restart && state->master != iMaster)
+    {
+        if (pwm_timers_reserved & (1 << iMaster)) return PWM_ERR_BUSY;
+        for (uint8_t i = 0; i < 4; i++)
+        {
+            if (pwm_timer_state[iMaster].channels[i]) return PWM_ERR_BUSY;
+        }
+    }
+
+    // ---------- Split period into master prescaler, master period and channel timer period ----------
+    PWM_timebase tb = { 0, state->arr, 0, 0 };
+    uint64_t num = (uint64_t)SystemCoreClock * 1000;
+    uint32_t mp = 1, ma = 0, a = (uint32_t)state->arr + 1;
+    if (!restart)
+    {
+        if (state->master != iMaster || state->f_millihz != f_millihz || state->arr < iCount) return PWM_ERR_CONFLICT;
+        mp = (uint32_t)pwm_timer_state[iMaster].prescaler + 1;
+        ma = (uint32_t)pwm_timer_state[iMaster].arr + 1;
+    }
+    else
+    {
+        if (f_millihz == 0) return PWM_ERR_FREQ;
+        uint64_t n_target = num / f_millihz;
+        mp = (uint32_t)((n_target + 0xFFFFFFFF) >> 32);             // Smallest master prescaler leaving 32 Bit for the periods
+        if (mp == 0) mp = 1;
+        if (mp > 65536) return PWM_ERR_FREQ;
+        // Master period of at least 2 counts, as a timer with ATRLR = 0 doesn't count
+        if (search_pwm_timebase(num, (uint64_t)f_millihz * mp, 2, (uint32_t)iCount + 1, &ma, &a) != PWM_OK) return PWM_ERR_FREQ;
+        tb.arr = a - 1;
+    }
+    uint64_t n = (uint64_t)mp * ma * a;
+    tb.f_actual = (uint32_t)((SystemCoreClock + (n >> 1)) / n);
+    tb.f_error_ppm = (int32_t)(((int64_t)num - (int64_t)f_millihz * (int64_t)n) * 1000000LL / ((int64_t)f_millihz * (int64_t)n));
+
+    // ---------- Master counts the division, TRGO on update ----------
+    if (restart)
+    {
+        end_pwm_cascade(iTimer);
+        end_pwm_cascade(iMaster);
+        PWM_timer_state *mstate = &pwm_timer_state[iMaster];
+        TIM_TimeBaseInitTypeDef TIM_TimeBaseInitStructure={0};
+        enable_pwm_timer_clock(iMaster);
+        enable_pwm_timer_clock(iTimer);
+        master->CTLR1 &= (uint16_t)~TIM_CEN;
+        TIM_TimeBaseInitStructure.TIM_Period = ma - 1;
+        TIM_TimeBaseInitStructure.TIM_Prescaler = mp - 1;
+        TIM_TimeBaseInitStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+        TIM_TimeBaseInitStructure.TIM_CounterMode = TIM_CounterMode_Up;
+        TIM_TimeBaseInit(master, &TIM_TimeBaseInitStructure);      // Update event before the slave listens
+        TIM_SelectOutputTrigger(master, TIM_TRGOSource_Update);
+        mstate->prescaler = mp - 1;
+        mstate->arr = ma - 1;
+        mstate->f_base = 0;
+        mstate->counter_mode = PWM_COUNT_UP;
+        mstate->update_mode = PWM_UPDATE_BOTH;
+        mstate->center = 0;
+        pwm_timers_reserved |= 1 << iMaster;
+        disable_pwm_freq_dither(iTimer);
+        state->counter_mode = PWM_COUNT_UP;                     // Channel timer period is counted in master periods
+        state->update_mode = PWM_UPDATE_BOTH;
+        state->center = 0;
+        TIM_ITRxExternalClockConfig(tim, pwm_itr_table[iTimer][iMaster]);
+        state->master = iMaster;
+        state->f_millihz = f_millihz;
+    }
+    // f_base in Hz is rounded and kept non-zero, it is the reference of the error when the channels are rescaled later
+    uint32_t f_base = (f_millihz + 500) / 1000;
+    setup_pwm_channel(object, iTimer, iChannel, u16Pin, PWM_REMAP_NONE, f_base ? f_base : 1, iCount, iPwm_mode, &tb, restart, 0);
+    object->f_avg_millihz = calc_pwm_millihz(num, n);
+    state->f_base = 0;                                          // Not shared with channels on the internal clock
+    if (restart) master->CTLR1 |= TIM_CEN;
+    return PWM_OK;
+    #endif
+}
+
+/*********************************************************************
+ * @fn      is_pwm_cascaded
+ *
+ * @brief   Check if a timer is clocked by a master timer (see init_pwm_cascade()) instead of the
+ *          internal clock, e.g. before modulators that compute periods from the timer clock
+ * 
+ * @param   iTimer      Timer (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ *
+ * @return  1 if cascaded, 0 if on the internal clock
+ */
+uint8_t is_pwm_cascaded(uint8_t iTimer)
+{
+    if (get_pwm_timer(iTimer) == NULL) return 0;
+    return pwm_timer_state[iTimer].master != 0;
+}
+
+int var_init_pwm(init_pwm_args in)
+{
+    uint16_t iCount_out = in.iCount ? in.iCount : 254;
+    uint16_t iPwm_mode_out = in.iPwm_mode ? in.iPwm_mode : PWM_MODE2;
+    return init_pwm_base(in.object, in.iTimer, in.iChannel, in.u16Pin, in.iF_base, iCount_out, iPwm_mode_out);
+}
+
+int var_init_pwm_pin(init_pwm_pin_args in)
+{
+    uint16_t iCount_out = in.iCount ? in.iCount : 254;
+    uint16_t iPwm_mode_out = in.iPwm_mode ? in.iPwm_mode : PWM_MODE2;
+    return init_pwm_channel(in.object, in.iTimer, in.iChannel, in.u16Pin, in.remap, in.iF_base, iCount_out, iPwm_mode_out);
+}
+
+/*********************************************************************
+ * @fn      init_pwm_any_base
+ *
+ * @brief   Initialize handler for PWM structure on any free timer channel and its default pin.
+ *          First tries timers that already run at the same frequency with enough resolution,
+ *          then unused timers. Reserved timers and claimed pins are skipped.
+ * 
+ * @param   object      Pointer to PWM_handle struct to initialize
+ * @param   iF_base     Base carrier frequency of PWM signal (e.g. 10000 = 10kHz) 
+ * @param   iCount      Base for scaling duty cycle (max = iCount + 1, min = 0) (e.g. 254 for 8-Bit resolution)
+ * @param   iPwm_mode   PWM mode selection (PWM_MODE1 or PWM_MODE2)
+ *
+ * @return  PWM_OK on success, PWM_ERR_BUSY if no free channel is left, PWM_ERR_FREQ if frequency is not reachable,
+ *          PWM_ERR_PIN on CH32X035/X033 (default pins not mapped yet, use init_pwm() with explicit pin)
+ */
+static int init_pwm_any_base(PWM_handle *object, uint32_t iF_base, uint16_t iCount, uint16_t iPwm_mode)
+{
+    #if defined(CH32X035) || defined(CH32X033)
+    (void)object; (void)iF_base; (void)iCount; (void)iPwm_mode;
+    return PWM_ERR_PIN;
+    #else
+    // ---------- Pass 0: share a timer with same frequency, pass 1: take an unused timer ----------
+    for (uint8_t pass = 0; pass < 2; pass++)
+    {
+        for (uint8_t k = 0; k < sizeof(pwm_placement_order); k++)
+        {
+            uint8_t t = pwm_placement_order[k];
+            PWM_timer_state *state = &pwm_timer_state[t];
+            if (get_pwm_timer(t) == NULL || (pwm_timers_reserved & (1 << t))) continue;
+            uint8_t used = 0;
+            for (uint8_t i = 0; i < 4; i++) used += (state->channels[i] != NULL);
+            if (pass == 0 && (used == 0 || state->f_base != iF_base || state->arr < iCount)) continue;
+            if (pass == 1 && used != 0) continue;
+            for (uint8_t i = 0; i < 4; i++)
+            {
+                uint16_t pin = pwm_default_pins[t][i];
+                if (pin == 0 || state->channels[i] != NULL || is_pwm_pin_used(pin)) continue;
+                return init_pwm_base(object, t, i + 1, pin, iF_base, iCount, iPwm_mode);
+            }
+        }
+    }
+    return PWM_ERR_BUSY;
+    #endif
+}
+
+int var_init_pwm_any(init_pwm_any_args in)
+{
+    uint16_t iCount_out = in.iCount ? in.iCount : 254;
+    uint16_t iPwm_mode_out = in.iPwm_mode ? in.iPwm_mode : PWM_MODE2;
+    return init_pwm_any_base(in.object, in.iF_base, iCount_out, iPwm_mode_out);
+}
+
+/*********************************************************************
+ * @fn      calc_pwm_compare
+ *
+ * @brief   Convert duty cycle to compare register value of PWM object, e.g. for DMA buffers
+ * 
+ * @param   object      Pointer to PWM_handle struct
+ * @param   duty        Duty cycle (0 = off, period + 1 = always on)
+ *
+ * @return  Compare register value
+ */
+uint16_t calc_pwm_compare(PWM_handle *object, uint16_t duty)
+{
+    uint32_t counts;
+    if (duty > object->period)
+    {
+        counts = object->arr + 1; // Clip invalid duty cycle to maximum (e.g. 255 for count = 254 -> always on)
+    } 
+    else 
+    {
+        counts = ((uint32_t)duty * object->duty_scale + 0x8000) >> 16;     // Scale duty to timer counts, exact if arr == period
+    }
+    // invert for 255 = full on, 0 = full off
+    return (uint16_t)(object->arr + 1 - counts);
+}
+
+/*********************************************************************
+ * @fn      calc_pwm_compare_q16
+ *
+ * @brief   Convert a Q16 duty cycle fraction to the compare register value of PWM object, independent of
+ *          the handle's duty cycle scale. The fraction is multiplied by the counts per period,
+ *          no division per conversion.
+ * 
+ * @param   object      Pointer to PWM_handle struct
+ * @param   duty        Duty cycle as fraction of the period in Q16 (0 = off, 32768 = 50%, 65536 = always on)
+ *
+ * @return  Compare register value
+ */
+uint16_t calc_pwm_compare_q16(PWM_handle *object, uint32_t duty)
+{
+    uint32_t len = (uint32_t)object->arr + 1;
+    uint32_t counts = (duty >= 0x10000) ? len : (duty * len + 0x8000) >> 16;
+    return (uint16_t)(len - counts);
+}
+
+/*********************************************************************
+ * @fn      mark_pwm_update_pending
+ *
+ * @brief   Track a compare value written to the preload register of PWM object until the next update event
+ * 
+ * @param   object      Pointer to PWM_handle struct
+ *
+ * @return  None
+ */
+static void mark_pwm_update_pending(PWM_handle *object)
+{
+    if (!object->preload) return;
+    // Without update interrupt, restart the update flag to detect the next update event by polling
+    if (!(object->tim->DMAINTENR & TIM_UIE)) object->tim->INTFR = (uint16_t)~TIM_UIF;
+    object->update_pending = 1;
+}
+
+/*********************************************************************
+ * @fn      write_pwm_compare
+ *
+ * @brief   Write a compare value of PWM object and track its preload
+ * 
+ * @param   object      Pointer to PWM_handle struct
+ * @param   compare     Compare register value
+ *
+ * @return  None
+ */
+static void write_pwm_compare(PWM_handle *object, uint16_t compare)
+{
+    object->duty_cycle = compare;
+    *object->ccr = compare;
+    mark_pwm_update_pending(object);
+}
+
+/*********************************************************************
+ * @fn      set_pwm_dither
+ *
+ * @brief   Set 16-Bit duty cycle of a dithered PWM object. The compare value for the integer
+ *          part of the timer counts is stored in duty_cycle, the fractional part is spread
+ *          evenly over 2^dither_bits periods by sigma-delta (one count more in frac periods).
+ * 
+ * @param   object      Pointer to PWM_handle struct with dithering enabled
+ * @param   duty        Duty cycle (0 = off, 65535 = on for all but 1/65536 of the period, 65536 = always on)
+ *
+ * @return  None
+ */
+static void set_pwm_dither(PWM_handle *object, uint32_t duty)
+{
+    uint32_t len = (uint32_t)object->arr + 1;
+    uint32_t q = (duty >= 0x10000) ? 0 : duty * len;                          // Timer counts in Q16
+    uint8_t bits = object->dither_bits;
+    uint16_t compare = (uint16_t)(len - ((duty >= 0x10000) ? len : (q >> 16)));
+    object->dither_frac = (uint8_t)((q & 0xFFFF) >> (16 - bits));
+    if (object->dither_table)
+    {
+        // ---------- Rewrite sequence streamed by DMA ----------
+        uint8_t acc = 0;
+        uint8_t mask = (1 << bits) - 1;
+        object->duty_cycle = compare;
+        for (uint8_t i = 0; i <= mask; i++)
+        {
+            acc += object->dither_frac;
+            object->dither_table[i] = compare - (acc >> bits);              // Lower compare value = one count more on
+            acc &= mask;
+        }
+        mark_pwm_update_pending(object);                                    // DMA moves the sequence into the preload register
+    }
+    else
+    {
+        write_pwm_compare(object, compare);                                 // Update interrupt adds the fraction
+    }
+}
+
+/*********************************************************************
+ * @fn      set_pwm_dutycycle
+ *
+ * @brief   Set duty cycle of PWM object. Only writes the cached compare register,
+ *          an output disabled with disable_pwm_output() stays disabled.
+ * 
+ * @param   object      Pointer to PWM_handle struct to control duty cycle of
+ * @param   duty        Duty cycle (e.g. 8-Bit resultion -> [0:255], with dithering always 16-Bit -> [0:65535])
+ *
+ * @return  None
+ */
+void set_pwm_dutycycle(PWM_handle *object, uint16_t duty)
+{
+    if (object->dither_bits)
+    {
+        set_pwm_dither(object, duty);
+        return;
+    }
+    // ---------- Set Timer PWM duty cycle ----------
+    write_pwm_compare(object, calc_pwm_compare(object, duty));
+}
+
+/*********************************************************************
+ * @fn      set_pwm_dutycycle_q16
+ *
+ * @brief   Set duty cycle of PWM object as a fraction of the period, independent of iCount and the
+ *          frequency (see calc_pwm_compare_q16()). With dithering, the fraction below one count is dithered.
+ * 
+ * @param   object      Pointer to PWM_handle struct to control duty cycle of
+ * @param   duty        Duty cycle in Q16 (0 = off, 32768 = 50%, 65536 = always on)
+ *
+ * @return  None
+ */
+void set_pwm_dutycycle_q16(PWM_handle *object, uint32_t duty)
+{
+    if (object->dither_bits)
+    {
+        set_pwm_dither(object, duty);
+        return;
+    }
+    write_pwm_compare(object, calc_pwm_compare_q16(object, duty));
+}
+
+/*********************************************************************
+ * @fn      set_pwm_compare
+ *
+ * @brief   Set the compare register value of PWM object directly (e.g. from modulators computing
+ *          in counts of the period). Like set_pwm_dutycycle(), a preloaded value is tracked by
+ *          is_pwm_update_pending() until the next update event.
+ * 
+ * @param   object      Pointer to PWM_handle struct
+ * @param   compare     Compare register value (0 = always on, arr + 1 = off, see calc_pwm_compare())
+ *
+ * @return  None
+ */
+void set_pwm_compare(PWM_handle *object, uint16_t compare)
+{
+    write_pwm_compare(object, compare);
+}
+
+/*********************************************************************
+ * @fn      enable_pwm_output
+ *
+ * @brief   Enable PWM output
+ * 
+ * @param   object      Pointer to PWM_handle struct to enable output of
+ *
+ * @return  None
+ */
+void enable_pwm_output(PWM_handle *object)
+{
+    object->tim->CCER |= object->ccer_mask;
+}
+
+/*********************************************************************
+ * @fn      disable_pwm_output
+ *
+ * @brief   Disable PWM output
+ * 
+ * @param   object      Pointer to PWM_handle struct to disable output of
+ *
+ * @return  None
+ */
+void disable_pwm_output(PWM_handle *object)
+{
+    object->tim->CCER &= (uint16_t)~object->ccer_mask;
+}
+
+/*********************************************************************
+ * @fn      set_pwm_preload
+ *
+ * @brief   Enable/disable compare register preload. With preload enabled, a new duty cycle
+ *          is written to the shadow register and takes effect at the next update event,
+ *          so writes in the middle of a period can not produce runt or double pulses.
+ * 
+ * @param   object      Pointer to PWM_handle struct to configure
+ * @param   state       ENABLE or DISABLE
+ *
+ * @return  None
+ */
+void set_pwm_preload(PWM_handle *object, FunctionalState state)
+{
+    uint16_t mode = (state == ENABLE) ? TIM_OCPreload_Enable : TIM_OCPreload_Disable;
+    switch (object->channel)
+    {
+        case PWM_CH1:
+            TIM_OC1PreloadConfig(object->tim, mode);
+            break;
+        case PWM_CH2:
+            TIM_OC2PreloadConfig(object->tim, mode);
+            break;
+        case PWM_CH3:
+            TIM_OC3PreloadConfig(object->tim, mode);
+            break;
+        case PWM_CH4:
+            TIM_OC4PreloadConfig(object->tim, mode);
+            break;
+    }
+    object->preload = (state == ENABLE);
+    object->update_pending = 0;
+}
+
+/*********************************************************************
+ * @fn      enable_pwm_dither
+ *
+ * @brief   Extend duty cycle resolution beyond the timer period by dithering: the compare value
+ *          alternates between N and N + 1 counts over a sequence of 2^frac_bits periods, so the
+ *          average duty cycle gains frac_bits of resolution at the same carrier frequency.
+ *          Afterwards set_pwm_dutycycle() takes a 16-Bit duty cycle (0 - 65535), independent of iCount.
+ *          The sequence is either streamed from a table by DMA (one dithered channel per timer, no CPU load)
+ *          or produced by the update interrupt (all channels, requires forwarding to pwm_irq_handler()).
+ *          Compare register preload is enabled so each period gets exactly one value.
+ * 
+ * @param   object      Pointer to initialized PWM_handle struct
+ * @param   frac_bits   Fractional bits (1 - 6, sequence of 2 - 64 periods)
+ * @param   table       Buffer of 2^frac_bits values for DMA dithering, NULL for update interrupt dithering
+ *
+ * @return  PWM_OK on success, PWM_ERR_RANGE if frac_bits is invalid, PWM_ERR_TIMER/PWM_ERR_BUSY if the
+ *          DMA stream can't be started (see start_pwm_stream())
+ */
+int enable_pwm_dither(PWM_handle *object, uint8_t frac_bits, uint16_t *table)
+{
+    if (object->tim == NULL) return PWM_ERR_TIMER;
+    if (frac_bits == 0 || frac_bits > 6) return PWM_ERR_RANGE;
+    if (object->dither_bits) disable_pwm_dither(object);
+    object->dither_bits = frac_bits;
+    object->dither_table = table;
+    object->dither_acc = 0;
+    set_pwm_dither(object, 0);
+    if (table)
+    {
+        int ret = start_pwm_stream(object, table, 1 << frac_bits, PWM_STREAM_CIRCULAR, NULL);
+        if (ret != PWM_OK)
+        {
+            object->dither_bits = 0;
+            object->dither_table = NULL;
+            return ret;
+        }
+    }
+    else
+    {
+        set_pwm_preload(object, ENABLE);
+        update_pwm_irq(object->timer);
+    }
+    return PWM_OK;
+}
+
+/*********************************************************************
+ * @fn      disable_pwm_dither
+ *
+ * @brief   Stop dithering of PWM object. The integer part of the last duty cycle stays active,
+ *          set_pwm_dutycycle() takes duty cycles scaled to iCount again.
+ * 
+ * @param   object      Pointer to PWM_handle struct
+ *
+ * @return  None
+ */
+void disable_pwm_dither(PWM_handle *object)
+{
+    if (!object->dither_bits) return;
+    if (object->dither_table) stop_pwm_stream(object->timer);
+    object->dither_bits = 0;
+    object->dither_table = NULL;
+    *object->ccr = object->duty_cycle;
+    update_pwm_irq(object->timer);
+}
+
+/*********************************************************************
+ * @fn      enable_pwm_freq_dither
+ *
+ * @brief   Reach a carrier frequency between two integer dividers: the timer period alternates between
+ *          N and N + 1 counts in a sigma-delta sequence, so the long-term average frequency matches
+ *          the target (to ppm accuracy for long sequences). The sequence is streamed into ATRLR by DMA
+ *          from a table (no CPU load, DMA channel of the timer is occupied) or produced by the update
+ *          interrupt with a 16-Bit fraction (requires forwarding to pwm_irq_handler()).
+ *          The average frequency and the peak cycle-to-cycle jitter (one timer count) are stored in
+ *          f_avg_millihz and jitter_ps of all handles on the timer. Compare values stay constant,
+ *          so the on-time of each channel follows the period by at most one count.
+ *          Call after all channels of the timer are initialized.
+ * 
+ * @param   iTimer      Timer (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ * @param   f_millihz   Target frequency in mHz (e.g. 32768500 = 32768.5Hz)
+ * @param   table       Buffer of length periods for DMA dithering, NULL for update interrupt dithering
+ * @param   length      Length of table, resolution of the average period is 1 / length count
+ *
+ * @return  PWM_OK on success, PWM_ERR_TIMER if no channel is initialized on the timer or it has no DMA
+ *          request mapping, PWM_ERR_RANGE if an argument is invalid, PWM_ERR_FREQ if frequency is not
+ *          reachable with the resolution of the channels, PWM_ERR_BUSY if a DMA stream (e.g. spread spectrum,
+ *          frequency sweep) drives the timer or it is cascaded (see init_pwm_cascade()), nothing is changed then
+ */
+int enable_pwm_freq_dither(uint8_t iTimer, uint32_t f_millihz, uint16_t *table, uint16_t length)
+{
+    TIM_TypeDef *tim = get_pwm_timer(iTimer);
+    if (tim == NULL) return PWM_ERR_TIMER;
+    PWM_timer_state *state = &pwm_timer_state[iTimer];
+    uint16_t min_count = 0;
+    uint8_t used = 0;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        PWM_handle *h = state->channels[i];
+        if (h == NULL) continue;
+        used = 1;
+        if (h->period > min_count) min_count = h->period;
+    }
+    if (!used) return PWM_ERR_TIMER;
+    if (f_millihz == 0 || (table != NULL && length == 0)) return PWM_ERR_RANGE;
+    if (table != NULL && get_pwm_dma_channel(iTimer) == NULL) return PWM_ERR_TIMER;
+    if (state->master) return PWM_ERR_BUSY;                     // Cascaded timers count master periods
+    if (is_pwm_stream_active(iTimer) && state->arr_table == NULL) return PWM_ERR_BUSY;     // Other stream writes the timer registers
+    disable_pwm_freq_dither(iTimer);
+
+    // ---------- Period in 1 / den counts, keep prescaler if possible ----------
+    uint32_t den = table ? length : 65536;
+    uint64_t num = (uint64_t)get_pwm_clock(iTimer) * 1000 * den;
+    PWM_timebase tb = { state->prescaler, state->arr, 0, 0 };
+    uint64_t div = (uint64_t)f_millihz * ((uint32_t)tb.prescaler + 1);
+    uint64_t n_q = (num + (div >> 1)) / div;
+    if (n_q / den <= min_count || n_q > (uint64_t)65536 * den)
+    {
+        if (solve_pwm_timer(&tb, state->center, (f_millihz + 500) / 1000, min_count) != PWM_OK) return PWM_ERR_FREQ;
+        div = (uint64_t)f_millihz * ((uint32_t)tb.prescaler + 1);
+        n_q = (num + (div >> 1)) / div;
+        if (n_q / den <= min_count || n_q > (uint64_t)65536 * den) return PWM_ERR_FREQ;
+    }
+    uint32_t base = (uint32_t)(n_q / den);
+    uint32_t frac = (uint32_t)(n_q % den);
+
+    // ---------- Move channels to base period ----------
+    tb.arr = (uint16_t)(base - 1);
+    rescale_pwm_channels(iTimer, &tb, NULL);
+    state->prescaler = tb.prescaler;
+    state->arr = tb.arr;
+    tim->PSC = tb.prescaler;
+    tim->ATRLR = tb.arr + state->center;
+
+    // ---------- Report average frequency and jitter ----------
+    uint32_t f_avg = calc_pwm_millihz(num, n_q * ((uint32_t)tb.prescaler + 1));
+    uint32_t f_clk = get_pwm_clock(iTimer);
+    uint32_t jitter = frac ? (uint32_t)(((uint64_t)((uint32_t)tb.prescaler + 1) * 1000000000000ULL + (f_clk >> 1)) / f_clk) : 0;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        PWM_handle *h = state->channels[i];
+        if (h == NULL) continue;
+        h->f_avg_millihz = f_avg;
+        h->jitter_ps = jitter;
+        h->f_actual = (f_avg + 500) / 1000;
+        h->f_error_ppm = (int32_t)(((int64_t)f_avg - (int64_t)f_millihz) * 1000000LL / (int64_t)f_millihz);
+    }
+    if (frac == 0) return PWM_OK;                               // Integer period, nothing to dither
+
+    // ---------- Start sequence ----------
+    state->arr_table = table;
+    state->arr_frac = frac;
+    state->arr_den = den;
+    state->arr_acc = 0;
+    if (table)
+    {
+        uint32_t acc = 0;
+        for (uint16_t i = 0; i < length; i++)
+        {
+            acc += frac;
+            table[i] = tb.arr + state->center + (acc >= den);
+            if (acc >= den) acc -= den;
+        }
+        int ret = start_pwm_dma(iTimer, &tim->ATRLR, table, length, PWM_STREAM_CIRCULAR, NULL);
+        if (ret != PWM_OK)
+        {
+            state->arr_den = 0;
+            state->arr_table = NULL;
+            return ret;
+        }
+    }
+    else
+    {
+        update_pwm_irq(iTimer);
+    }
+    return PWM_OK;
+}
+
+/*********************************************************************
+ * @fn      disable_pwm_freq_dither
+ *
+ * @brief   Stop frequency dithering of a timer, the base period (N counts) stays active
+ * 
+ * @param   iTimer      Timer (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ *
+ * @return  None
+ */
+void disable_pwm_freq_dither(uint8_t iTimer)
+{
+    TIM_TypeDef *tim = get_pwm_timer(iTimer);
+    if (tim == NULL) return;
+    PWM_timer_state *state = &pwm_timer_state[iTimer];
+    if (state->arr_den == 0) return;
+    if (state->arr_table) stop_pwm_stream(iTimer);
+    state->arr_den = 0;
+    state->arr_table = NULL;
+    tim->ATRLR = state->arr + state->center;
+    update_pwm_irq(iTimer);
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        PWM_handle *h = state->channels[i];
+        if (h == NULL) continue;
+        PWM_timebase tb = { h->prescaler, h->arr, 0, 0 };
+        eval_pwm_timebase(&tb, get_pwm_clock(iTimer), h->f_base);
+        h->f_actual = tb.f_actual;
+        h->f_error_ppm = tb.f_error_ppm;
+        h->f_avg_millihz = calc_pwm_millihz((uint64_t)get_pwm_clock(iTimer) * 1000, ((uint64_t)h->prescaler + 1) * ((uint64_t)h->arr + 1));
+        h->jitter_ps = 0;
+    }
+}
+
+/*********************************************************************
+ * @fn      is_pwm_freq_dither_active
+ *
+ * @brief   Check if the period of a timer is dithered by enable_pwm_freq_dither()
+ * 
+ * @param   iTimer      Timer (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ *
+ * @return  1 if dithering by DMA or update interrupt, 0 if the period is constant
+ */
+uint8_t is_pwm_freq_dither_active(uint8_t iTimer)
+{
+    if (get_pwm_timer(iTimer) == NULL) return 0;
+    return pwm_timer_state[iTimer].arr_den != 0;
+}
+
+/*********************************************************************
+ * @fn      set_pwm_dutycycles
+ *
+ * @brief   Set duty cycles of several PWM objects atomically. Update events of all involved
+ *          timers are held back (UDIS) while the compare registers are written, so all new values
+ *          of a timer take effect together at its next update event. Preload is enabled on every
+ *          passed object that does not use it yet. Channels on different timers change at the
+ *          same update event only if the timers run synchronized (see start_pwm_group()).
+ * 
+ * @param   objects     Array of pointers to PWM_handle structs to update
+ * @param   duties      Array of duty cycles, one per object (scaled like set_pwm_dutycycle())
+ * @param   count       Number of objects
+ *
+ * @return  None
+ */
+void set_pwm_dutycycles(PWM_handle *objects[], const uint16_t duties[], uint8_t count)
+{
+    uint8_t timers = 0;
+    // ---------- Hold back update events ----------
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (!(timers & (1 << objects[i]->timer)))
+        {
+            timers |= 1 << objects[i]->timer;
+            objects[i]->tim->CTLR1 |= TIM_UDIS;
+        }
+    }
+    // ---------- Write shadow registers ----------
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (!objects[i]->preload) set_pwm_preload(objects[i], ENABLE);
+        set_pwm_dutycycle(objects[i], duties[i]);
+    }
+    // ---------- Release update events, next one transfers all values ----------
+    for (uint8_t t = PWM_TIM1; t <= PWM_TIM4; t++)
+    {
+        if (timers & (1 << t)) get_pwm_timer(t)->CTLR1 &= (uint16_t)~TIM_UDIS;
+    }
+}
+
+/*********************************************************************
+ * @fn      start_pwm_group
+ *
+ * @brief   Restart several timers so that all counters start in the same clock cycle.
+ *          The first timer is the master, its counter enable is routed via TRGO to the
+ *          other timers, which wait in trigger slave mode. Each counter is preloaded with
+ *          its phase offset before the start. Afterwards, the timers run freely again.
+ *          All timers have to be in PWM use (not reserved, measuring an input or clocking a cascade).
+ *          Not available on CH32X035/X033.
+ * 
+ * @param   iTimers     Array of timers (PWM_TIM1, ...), iTimers[0] is the master
+ * @param   phases      Array of phase leads per timer as fraction of its period (65536 = 360 deg),
+ *                      e.g. {0, 21845, 43690} for 3-phase interleaving, NULL for no offsets
+ * @param   count       Number of timers
+ *
+ * @return  PWM_OK on success, PWM_ERR_TIMER if a timer is invalid, cascaded or can't be triggered by the master,
+ *          PWM_ERR_BUSY if a timer is reserved, measures an input or is the master of a cascade,
+ *          PWM_ERR_TIMEOUT if a slave did not start with the master (it is started unsynchronized then)
+ */
+int start_pwm_group(const uint8_t iTimers[], const uint16_t phases[], uint8_t count)
+{
+    #if defined(CH32X035) || defined(CH32X033)
+    return PWM_ERR_TIMER;
+    #else
+    if (count == 0 || get_pwm_timer(iTimers[0]) == NULL) return PWM_ERR_TIMER;
+    for (uint8_t i = 1; i < count; i++)
+    {
+        if (get_pwm_timer(iTimers[i]) == NULL || pwm_itr_table[iTimers[i]][iTimers[0]] == 0xFFFF) return PWM_ERR_TIMER;
+    }
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (pwm_timer_state[iTimers[i]].master) return PWM_ERR_TIMER;  // Slave mode taken by the cascade
+        // Reserved by the user or another library, input capture and cascade masters reserve their timer as well
+        if ((pwm_timers_reserved & (1 << iTimers[i])) || pwm_timer_state[iTimers[i]].capture) return PWM_ERR_BUSY;
+    }
+    TIM_TypeDef *master = get_pwm_timer(iTimers[0]);
+    int ret = PWM_OK;
+
+    // ---------- Stop all counters and preload phase offsets ----------
+    for (uint8_t i = 0; i < count; i++)
+    {
+        TIM_TypeDef *tim = get_pwm_timer(iTimers[i]);
+        tim->CTLR1 &= (uint16_t)~TIM_CEN;
+        tim->CTLR1 |= TIM_URS;                  // Reset prescaler counter without update interrupt
+        tim->SWEVGR = TIM_UG;
+        tim->CTLR1 &= (uint16_t)~TIM_URS;
+        tim->CNT = phases ? (uint16_t)(((uint32_t)phases[i] * ((uint32_t)tim->ATRLR + 1)) >> 16) : 0;
+        if (i > 0)
+        {
+            TIM_SelectInputTrigger(tim, pwm_itr_table[iTimers[i]][iTimers[0]]);
+            TIM_SelectSlaveMode(tim, TIM_SlaveMode_Trigger);
+        }
+    }
+
+    // ---------- Start master, slaves follow via TRGO ----------
+    TIM_SelectOutputTrigger(master, TIM_TRGOSource_Enable);
+    TIM_SelectMasterSlaveMode(master, TIM_MasterSlaveMode_Enable);
+    master->CTLR1 |= TIM_CEN;
+
+    // ---------- Return to free running timers ----------
+    for (uint8_t i = 1; i < count; i++)
+    {
+        TIM_TypeDef *tim = get_pwm_timer(iTimers[i]);
+        uint16_t polls = PWM_START_POLLS;
+        while (!(tim->CTLR1 & TIM_CEN) && --polls);     // Set by hardware within a few clock cycles
+        tim->SMCFGR &= (uint16_t)~TIM_SMS;
+        if (!(tim->CTLR1 & TIM_CEN))
+        {
+            tim->CTLR1 |= TIM_CEN;              // Keep the outputs running, but without phase relation
+            ret = PWM_ERR_TIMEOUT;
+        }
+    }
+    TIM_SelectMasterSlaveMode(master, TIM_MasterSlaveMode_Disable);
+    TIM_SelectOutputTrigger(master, TIM_TRGOSource_Update);
+    return ret;
+    #endif
+}
+
+/*********************************************************************
+ * @fn      enable_pwm_complementary
+ *
+ * @brief   Enable complementary output (CHxN) of a channel on TIM1 (CH1 - CH3), e.g. for half-bridges.
+ *          enable_pwm_output()/disable_pwm_output() switch both outputs afterwards.
+ * 
+ * @param   object          Pointer to PWM_handle struct of TIM1 channel
+ * @param   u16PinN         Pin for complementary output (e.g 0x0B0D for PB13 = TIM1_CH1N)
+ * @param   idle_state      Level of main output when outputs are off (TIM_OCIdleState_Set or TIM_OCIdleState_Reset)
+ * @param   idle_state_n    Level of complementary output when outputs are off (TIM_OCNIdleState_Set or TIM_OCNIdleState_Reset)
+ *
+ * @return  PWM_OK on success, PWM_ERR_TIMER if channel has no complementary output, PWM_ERR_PIN if invalid pin specified,
+ *          PWM_ERR_BUSY if pin already in use
+ */
+int enable_pwm_complementary(PWM_handle *object, uint16_t u16PinN, uint16_t idle_state, uint16_t idle_state_n)
+{
+    if (object->timer != PWM_TIM1 || object->channel == PWM_CH4) return PWM_ERR_TIMER;
+    int ret = claim_pwm_pin(u16PinN);
+    if (ret != PWM_OK) return ret;
+    init_pwm_gpio(u16PinN, GPIO_Mode_AF_PP);
+    release_pwm_pin(object->pin_n);
+    object->pin_n = u16PinN;
+    uint8_t shift = (object->channel - 1) * 4;
+    uint8_t ois_shift = (object->channel - 1) * 2;
+    // ---------- Idle states (OISx, OISxN), applied when MOE is cleared ----------
+    object->tim->CTLR2 = (object->tim->CTLR2 & (uint16_t)~((TIM_OCIdleState_Set | TIM_OCNIdleState_Set) << ois_shift))
+                       | (uint16_t)((idle_state | idle_state_n) << ois_shift);
+    // ---------- Enable CHxN with same polarity as CHx ----------
+    object->tim->CCER = (object->tim->CCER & (uint16_t)~(TIM_CC1NP << shift)) | (uint16_t)(TIM_CC1NE << shift);
+    object->ccer_mask |= TIM_CC1NE << shift;
+    return PWM_OK;
+}
+
+/*********************************************************************
+ * @fn      set_pwm_deadtime
+ *
+ * @brief   Set dead time inserted between complementary outputs and the off-state selection of TIM1.
+ *          The dead time is rounded up to the next value the DTG encoding can represent
+ *          (up to 1008 timer clocks, e.g. 7us at 144MHz).
+ * 
+ * @param   iTimer      Timer with complementary outputs (PWM_TIM1)
+ * @param   deadtime_ns Dead time in nanoseconds
+ * @param   ossr        Off-state in run mode (TIM_OSSRState_Enable or TIM_OSSRState_Disable)
+ * @param   ossi        Off-state in idle mode (TIM_OSSIState_Enable or TIM_OSSIState_Disable)
+ *
+ * @return  PWM_OK on success, PWM_ERR_TIMER if timer has no dead time generator, PWM_ERR_RANGE if dead time too long
+ */
+int set_pwm_deadtime(uint8_t iTimer, uint32_t deadtime_ns, uint16_t ossr, uint16_t ossi)
+{
+    if (iTimer != PWM_TIM1) return PWM_ERR_TIMER;
+    uint32_t ticks = (uint32_t)(((uint64_t)deadtime_ns * SystemCoreClock + 999999999ULL) / 1000000000ULL);
+    uint16_t dtg;
+    // ---------- Encode DTG, each range with coarser steps ----------
+    if (ticks <= 127) dtg = ticks;                                          // DT = DTG * tDTS
+    else if (ticks <= 254) dtg = 0x80 | ((ticks + 1) / 2 - 64);             // DT = (64 + DTG[5:0]) * 2 * tDTS
+    else if (ticks <= 504) dtg = 0xC0 | ((ticks + 7) / 8 - 32);             // DT = (32 + DTG[4:0]) * 8 * tDTS
+    else if (ticks <= 1008) dtg = 0xE0 | ((ticks + 15) / 16 - 32);          // DT = (32 + DTG[4:0]) * 16 * tDTS
+    else return PWM_ERR_RANGE;
+    TIM1->BDTR = (TIM1->BDTR & (uint16_t)~(TIM_DTG | TIM_OSSR | TIM_OSSI)) | dtg | ossr | ossi;
+    return PWM_OK;
+}
 
 /*********************************************************************
- * @fn      init_pwm_base
+ * @fn      enable_pwm_break
  *
- * @brief   Initialize handler for PWM structure. This makes a pin ready for PWM output.
+ * @brief   Enable hardware break input of TIM1. An active break input clears MOE in hardware,
+ *          all outputs of the timer switch to their off-state / idle levels (see set_pwm_deadtime()
+ *          and enable_pwm_complementary()) without software involvement. Every break event is
+ *          counted and timestamped in all handles of the timer by pwm_irq_handler(), which has to
+ *          be called from TIM1_BRK_IRQHandler.
  * 
- * @param   object      Pointer to PWM_handle struct to initialize
- * @param   iTimer      Timer to use for PWM (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
- * @param   iChannel    Channel of time to use for PWM (PWM_CH1, PWM_CH2, PWM_CH3 or PWM_CH4)
- * @param   u16Pin      Pin for outputting PWM signal (e.g 0x0A08 for PA8 ...)
- * @param   iF_base     Base carrier frequency of PWM signal (e.g. 10000 = 10kHz) 
- *                      WARNIGN: Due to integer divison, the actual frequency only roughly follows the specified one.
- * @param   iCount      Base for scaling duty cycle (max = iCount + 1, min = 0) (e.g. 254 for 8-Bit resolution)
- * @param   iPwm_mode   PWM mode selection, changes precision of actual output (PWM_MODE1 or PWM_MODE2)
+ * @param   iTimer      Timer with break input (PWM_TIM1)
+ * @param   u16PinBKIN  Break input pin (e.g 0x0B0C for PB12 = TIM1_BKIN)
+ * @param   polarity    Active level of break input (TIM_BreakPolarity_Low or TIM_BreakPolarity_High)
+ * @param   auto_output Re-enable outputs at next update event after break input went inactive
+ *                      (TIM_AutomaticOutput_Enable), or only via clear_pwm_break() (TIM_AutomaticOutput_Disable)
+ * @param   callback    Function to call on break event, NULL for counting only
  *
- * @return  Normally returns 0 on exit, returns -1 if invalid pin specified
+ * @return  PWM_OK on success, PWM_ERR_TIMER if timer has no break input, PWM_ERR_PIN if invalid pin specified,
+ *          PWM_ERR_BUSY if pin already in use (calling again with the break pin of the timer re-configures it)
  */
-int init_pwm_base(PWM_handle *object, uint8_t iTimer, uint8_t iChannel, uint16_t u16Pin, uint32_t iF_base, uint16_t iCount, uint16_t iPwm_mode)
-{   
-    // --------- Set attributes ----------
-    object->pwm_mode = iPwm_mode;
-    object->timer = iTimer;
-    object->channel = iChannel;
-    object->period = iCount;
-    object->prescaler = SystemCoreClock / iCount / iF_base;     // Rough frequency match, only integer prescaler possible
+int enable_pwm_break(uint8_t iTimer, uint16_t u16PinBKIN, uint16_t polarity, uint16_t auto_output, pwm_break_callback callback)
+{
+    if (iTimer != PWM_TIM1) return PWM_ERR_TIMER;
+    PWM_timer_state *state = &pwm_timer_state[iTimer];
+    if (u16PinBKIN != state->break_pin)
+    {
+        int ret = claim_pwm_pin(u16PinBKIN);
+        if (ret != PWM_OK) return ret;
+        init_pwm_gpio(u16PinBKIN, GPIO_Mode_IN_FLOATING);
+        release_pwm_pin(state->break_pin);
+        state->break_pin = u16PinBKIN;
+    }
+    state->break_callback = callback;
+    TIM1->BDTR = (TIM1->BDTR & (uint16_t)~(TIM_BKE | TIM_BKP | TIM_AOE)) | TIM_Break_Enable | polarity | auto_output;
+    TIM_ClearITPendingBit(TIM1, TIM_IT_Break);
+    TIM_ITConfig(TIM1, TIM_IT_Break, ENABLE);
+    NVIC_EnableIRQ(TIM1_BRK_IRQn);
+    return PWM_OK;
+}
 
-    // ---------- Initialize ----------
-    GPIO_InitTypeDef GPIO_InitStructure={0};
-	TIM_TimeBaseInitTypeDef TIM_TimeBaseInitStructure={0};
+/*********************************************************************
+ * @fn      clear_pwm_break
+ *
+ * @brief   Re-enable outputs after a break event (sets MOE, only has effect once the break
+ *          input is inactive again) and re-arm the break interrupt.
+ * 
+ * @param   iTimer      Timer with break input (PWM_TIM1)
+ *
+ * @return  None
+ */
+void clear_pwm_break(uint8_t iTimer)
+{
+    if (iTimer != PWM_TIM1) return;
+    TIM_CtrlPWMOutputs(TIM1, ENABLE);
+    TIM_ClearITPendingBit(TIM1, TIM_IT_Break);
+    TIM_ITConfig(TIM1, TIM_IT_Break, ENABLE);
+}
 
-    // ---------- Set Pin as output ---------
-    if (u16Pin < 0x0a00 || u16Pin > 0x0dff) return -1; // invalid pin number
-    // based on pinMode() https://gist.github.com/bitbank2/13686b8a153a0b3a06839f4fa00589cb
-    GPIO_InitStructure.GPIO_Pin = GPIO_Pin_0 << (u16Pin & 0xff);
-    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF_PP;
-    GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
+/*********************************************************************
+ * @fn      disable_pwm_break
+ *
+ * @brief   Disable the break input of a timer and release its pin. Outputs switched off by a
+ *          break event stay off until clear_pwm_break().
+ * 
+ * @param   iTimer      Timer with break input (PWM_TIM1)
+ *
+ * @return  None
+ */
+void disable_pwm_break(uint8_t iTimer)
+{
+    if (iTimer != PWM_TIM1) return;
+    PWM_timer_state *state = &pwm_timer_state[iTimer];
+    TIM_ITConfig(TIM1, TIM_IT_Break, DISABLE);
+    TIM1->BDTR &= (uint16_t)~(TIM_BKE | TIM_AOE);
+    state->break_callback = NULL;
+    release_pwm_pin(state->break_pin);
+    state->break_pin = 0;
+}
+
+/*********************************************************************
+ * @fn      read_pwm_pin
+ *
+ * @brief   Read the level of a pin
+ * 
+ * @param   u16Pin      Pin (e.g 0x0A08 for PA8 ...)
+ *
+ * @return  1 if high, else 0
+ */
+static uint8_t read_pwm_pin(uint16_t u16Pin)
+{
+    uint16_t mask = GPIO_Pin_0 << (u16Pin & 0x0f);
     switch (u16Pin & 0x0f00)
     {
         case 0x0a00:
-            RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOA, ENABLE);
-            GPIO_Init(GPIOA, &GPIO_InitStructure);
-            break;
+            return (GPIOA->INDR & mask) != 0;
         case 0x0b00:
-            RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOB, ENABLE);
-            GPIO_Init(GPIOB, &GPIO_InitStructure);
-            break;
+            return (GPIOB->INDR & mask) != 0;
         case 0x0c00:
-            RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOC, ENABLE);
-            GPIO_Init(GPIOC, &GPIO_InitStructure);
-            break;
+            return (GPIOC->INDR & mask) != 0;
         #if !defined(CH32X035) && !defined(CH32X033)
         case 0x0d00:
-            RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOD, ENABLE);
-            GPIO_Init(GPIOD, &GPIO_InitStructure);
-            break;
+            return (GPIOD->INDR & mask) != 0;
         #endif
     }
-    // ---------- Initialize Timer ----------
-    TIM_TimeBaseInitStructure.TIM_Period = object->period;
-	TIM_TimeBaseInitStructure.TIM_Prescaler = object->prescaler;
-	TIM_TimeBaseInitStructure.TIM_ClockDivision = TIM_CKD_DIV1;
-	TIM_TimeBaseInitStructure.TIM_CounterMode = TIM_CounterMode_Up;
-    switch (object->timer)
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      init_pwm_capture
+ *
+ * @brief   Measure an external PWM signal (e.g. fan tachometer, sensor output) in PWM input mode.
+ *          Every rising edge on the pin captures the period and resets the counter (slave reset mode),
+ *          the falling edge captures the high time into the paired channel (CH1 / CH2). The whole timer
+ *          is used, it is reserved for the measurement until release_pwm_capture().
+ *          pwm_irq_handler() stores each period, so it has to be called from the timer's interrupt
+ *          handler (TIM1_CC_IRQHandler and TIM1_UP_IRQHandler for TIM1, TIM2_CC_IRQHandler and
+ *          TIM2_UP_IRQHandler for TIM2 on CH32X035, else TIMx_IRQHandler).
+ * 
+ * @param   capture     Pointer to PWM_capture struct to initialize, has to stay valid
+ * @param   iTimer      Timer (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ * @param   iChannel    Channel of the input pin (PWM_CH1 or PWM_CH2), the other one is used too
+ * @param   u16Pin      Input pin of the channel (e.g 0x0A08 for PA8 ...), AFIO remapping is left to the user
+ * @param   f_min       Lowest frequency to measure in Hz, sets the tick length (resolution), slower inputs read as no signal
+ * @param   filter      Input filter (0 - 15, ICxF), higher values suppress longer glitches
+ *
+ * @return  PWM_OK on success, PWM_ERR_TIMER if invalid timer or channel specified, PWM_ERR_PIN if invalid pin specified,
+ *          PWM_ERR_BUSY if timer or pin already in use, PWM_ERR_RANGE if f_min is 0 or filter > 15,
+ *          PWM_ERR_FREQ if f_min is too low for the prescaler
+ */
+int init_pwm_capture(PWM_capture *capture, uint8_t iTimer, uint8_t iChannel, uint16_t u16Pin, uint32_t f_min, uint8_t filter)
+{
+    TIM_TypeDef *tim = get_pwm_timer(iTimer);
+    if (tim == NULL || (iChannel != PWM_CH1 && iChannel != PWM_CH2)) return PWM_ERR_TIMER;
+    if (f_min == 0 || filter > 15) return PWM_ERR_RANGE;
+    PWM_timer_state *state = &pwm_timer_state[iTimer];
+    if ((pwm_timers_reserved & (1 << iTimer)) || state->capture) return PWM_ERR_BUSY;
+    for (uint8_t i = 0; i < 4; i++)
     {
-        case PWM_TIM1:
-            RCC_APB2PeriphClockCmd(RCC_APB2Periph_TIM1, ENABLE);
-            TIM_TimeBaseInit( TIM1, &TIM_TimeBaseInitStructure);
-            TIM_SelectOutputTrigger(TIM1, TIM_TRGOSource_Update);       // Enable self-resetting TRGO-Event when no PWM configured
-            TIM_Cmd(TIM1, ENABLE);
-            break;
-        case PWM_TIM2:
-            RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2 , ENABLE);
-            TIM_TimeBaseInit( TIM2, &TIM_TimeBaseInitStructure);
-            TIM_SelectOutputTrigger(TIM2, TIM_TRGOSource_Update);       // Enable self-resetting TRGO-Event when no PWM configured
-            TIM_Cmd(TIM2, ENABLE);
-            break;
-        case PWM_TIM3:
-            RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM3 , ENABLE);
-            TIM_TimeBaseInit( TIM3, &TIM_TimeBaseInitStructure);
-            TIM_SelectOutputTrigger(TIM3, TIM_TRGOSource_Update);       // Enable self-resetting TRGO-Event when no PWM configured
-            TIM_Cmd(TIM3, ENABLE);
-            break;
-        #if !defined(CH32X035) && !defined(CH32X033)
-        case PWM_TIM4:
-            RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM4 , ENABLE);
-            TIM_TimeBaseInit( TIM4, &TIM_TimeBaseInitStructure);
-            TIM_SelectOutputTrigger(TIM4, TIM_TRGOSource_Update);       // Enable self-resetting TRGO-Event when no PWM configured
-            TIM_Cmd(TIM4, ENABLE);
-            break;
-        #endif
+        if (state->channels[i]) return PWM_ERR_BUSY;
     }
-    return 0;
+    uint64_t per_tick = (uint64_t)f_min << 16;                  // One period of f_min fits into the 16-Bit counter
+    uint64_t divider = (SystemCoreClock + per_tick - 1) / per_tick;
+    if (divider == 0) divider = 1;
+    if (divider > 65536) return PWM_ERR_FREQ;
+    int ret = claim_pwm_pin(u16Pin);
+    if (ret != PWM_OK) return ret;
+    init_pwm_gpio(u16Pin, GPIO_Mode_IN_FLOATING);
+
+    capture->timer = iTimer;
+    capture->channel = iChannel;
+    capture->pin = u16Pin;
+    capture->divider = (uint32_t)divider;
+    capture->sample = 0;
+    capture->jitter = 0;
+    capture->count = 0;
+    capture->last = 0;
+    capture->peak = 0;
+    capture->window = 0;
+    capture->sync = 0;
+    pwm_timers_reserved |= 1 << iTimer;
+    state->capture = capture;
+
+    // ---------- Free running counter, reset by rising edges ----------
+    TIM_TimeBaseInitTypeDef TIM_TimeBaseInitStructure={0};
+    TIM_ICInitTypeDef TIM_ICInitStructure={0};
+    enable_pwm_timer_clock(iTimer);
+    tim->CTLR1 &= (uint16_t)~TIM_CEN;
+    TIM_TimeBaseInitStructure.TIM_Period = 0xFFFF;
+    TIM_TimeBaseInitStructure.TIM_Prescaler = (uint16_t)(divider - 1);
+    TIM_TimeBaseInitStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+    TIM_TimeBaseInitStructure.TIM_CounterMode = TIM_CounterMode_Up;
+    TIM_TimeBaseInit(tim, &TIM_TimeBaseInitStructure);
+    TIM_ICInitStructure.TIM_Channel = (iChannel == PWM_CH1) ? TIM_Channel_1 : TIM_Channel_2;
+    TIM_ICInitStructure.TIM_ICPolarity = TIM_ICPolarity_Rising;
+    TIM_ICInitStructure.TIM_ICSelection = TIM_ICSelection_DirectTI;
+    TIM_ICInitStructure.TIM_ICPrescaler = TIM_ICPSC_DIV1;
+    TIM_ICInitStructure.TIM_ICFilter = filter;
+    TIM_PWMIConfig(tim, &TIM_ICInitStructure);                  // Paired channel captures the falling edge of the same input
+    TIM_SelectInputTrigger(tim, (iChannel == PWM_CH1) ? TIM_TS_TI1FP1 : TIM_TS_TI2FP2);
+    TIM_SelectSlaveMode(tim, TIM_SlaveMode_Reset);
+    tim->CTLR1 |= TIM_URS;                                      // Only overflows (no edge within 1 / f_min) raise update interrupts
+
+    // ---------- Interrupts ----------
+    uint16_t cc_it = (iChannel == PWM_CH1) ? TIM_IT_CC1 : TIM_IT_CC2;
+    TIM_ClearITPendingBit(tim, cc_it);
+    TIM_ITConfig(tim, cc_it, ENABLE);
+    update_pwm_irq(iTimer);
+    #if defined(CH32X035) || defined(CH32X033)
+    if (iTimer == PWM_TIM2) NVIC_EnableIRQ(TIM2_CC_IRQn);
+    #endif
+    if (iTimer == PWM_TIM1) NVIC_EnableIRQ(TIM1_CC_IRQn);      // Other timers share one interrupt, enabled with the update interrupt
+    TIM_Cmd(tim, ENABLE);
+    return PWM_OK;
 }
 
-int var_init_pwm(init_pwm_args in)
+/*********************************************************************
+ * @fn      read_pwm_capture
+ *
+ * @brief   Get the latest reading of a PWM input. Never blocks: period and high time are published
+ *          by the interrupt as one word, so they always belong to the same period.
+ * 
+ * @param   capture     Pointer to initialized PWM_capture struct
+ * @param   value       Destination for frequency, duty cycle, jitter and period count
+ *
+ * @return  1 if a signal is present, 0 if there was no edge within 1 / f_min (duty cycle = input level)
+ */
+uint8_t read_pwm_capture(PWM_capture *capture, PWM_capture_value *value)
 {
-    uint16_t iCount_out = in.iCount ? in.iCount : 254;
-    uint16_t iPwm_mode_out = in.iPwm_mode ? in.iPwm_mode : PWM_MODE2;
-    return init_pwm_base(in.object, in.iTimer, in.iChannel, in.u16Pin, in.iF_base, iCount_out, iPwm_mode_out);
+    uint32_t sample = capture->sample;
+    uint32_t period = sample & 0xFFFF;
+    value->count = capture->count;
+    value->jitter_ns = (uint32_t)((uint64_t)capture->jitter * capture->divider * 1000000000ULL / SystemCoreClock);
+    if (period == 0)
+    {
+        value->f_millihz = 0;
+        value->duty_q16 = read_pwm_pin(capture->pin) ? 0x10000 : 0;
+        return 0;
+    }
+    value->f_millihz = calc_pwm_millihz((uint64_t)SystemCoreClock * 1000, (uint64_t)capture->divider * period);
+    value->duty_q16 = (uint32_t)(((uint64_t)(sample >> 16) << 16) / period);
+    return 1;
 }
 
 /*********************************************************************
- * @fn      set_pwm_dutycycle
+ * @fn      release_pwm_capture
  *
- * @brief   Set duty cycle of PWM object
+ * @brief   Stop a PWM input measurement and release its timer and pin. Does nothing if the
+ *          measurement is not running.
  * 
- * @param   object      Pointer to PWM_handle struct to control duty cycle of
- * @param   duty        Duty cycle (e.g. 8-Bit resultion -> [0:255])
+ * @param   capture     Pointer to PWM_capture struct to release
  *
  * @return  None
  */
-void set_pwm_dutycycle(PWM_handle *object, uint16_t duty)
+void release_pwm_capture(PWM_capture *capture)
 {
-    // ---------- Initialize base structure ----------
-    TIM_OCInitTypeDef TIM_OCInitStructure={0};
+    TIM_TypeDef *tim = get_pwm_timer(capture->timer);
+    if (tim == NULL || pwm_timer_state[capture->timer].capture != capture) return;
+    TIM_Cmd(tim, DISABLE);
+    TIM_ITConfig(tim, TIM_IT_CC1 | TIM_IT_CC2, DISABLE);
+    TIM_SelectSlaveMode(tim, 0);                                // Slave mode off, internal clock
+    tim->CCER &= (uint16_t)~(TIM_CC1E | TIM_CC2E);
+    tim->CHCTLR1 = 0;                                           // CH1 / CH2 back to output compare
+    tim->CTLR1 &= (uint16_t)~TIM_URS;
+    pwm_timer_state[capture->timer].capture = NULL;
+    update_pwm_irq(capture->timer);
+    pwm_timers_reserved &= (uint8_t)~(1 << capture->timer);
+    release_pwm_pin(capture->pin);
+    capture->sample = 0;
+}
 
-    if (object->pwm_mode == PWM_MODE1)
-    {
-        TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_PWM1;
-    }
-    else
-    {
-        TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_PWM2;
-    }
-    // ---------- Set Timer PWM duty cycle ----------
-    if (duty > (object->period + 1))
-    {
-        object->duty_cycle = object->period + 1; // Clip invalid duty cycle to maximum (e.g. 255 for count = 254 -> always off)
-    } 
-    else 
+/*********************************************************************
+ * @fn      start_pwm_segments
+ *
+ * @brief   Start a burst of repetition counter segments on TIM1. The repetition counter is reloaded
+ *          from RPTCR at every update event, so RPTCR always holds the segment after the running one:
+ *          the first length is loaded by a software update, the second is written before the start
+ *          and segment 3 onwards are streamed into RPTCR by DMA at the update events.
+ *          The update interrupt counts the segments and sets one-pulse mode in the last one.
+ * 
+ * @param   iTimer      Timer (PWM_TIM1)
+ * @param   first       Periods of first segment (1 - 256)
+ * @param   second      Periods of second segment (1 - 256)
+ * @param   list        RPTCR values of segments 3 ... n (NULL if n <= 2)
+ * @param   length      Number of values in list
+ * @param   segments    Total number of segments
+ * @param   callback    Function called at the end of the burst (NULL = none)
+ *
+ * @return  PWM_OK on success, PWM_ERR_TIMER or PWM_ERR_BUSY if the DMA stream of the list cannot be started
+ *          (timer continues as before with restarted period)
+ */
+static int start_pwm_segments(uint8_t iTimer, uint16_t first, uint16_t second, uint16_t *list, uint16_t length, uint32_t segments, pwm_burst_callback callback)
+{
+    TIM_TypeDef *tim = get_pwm_timer(iTimer);
+    PWM_timer_state *state = &pwm_timer_state[iTimer];
+    uint16_t ctlr1 = tim->CTLR1;
+
+    // ---------- Stop and load the first two segments ----------
+    tim->CTLR1 &= (uint16_t)~(TIM_CEN | TIM_OPM);
+    tim->CTLR1 |= TIM_URS;                      // Only overflows generate update interrupts and DMA requests
+    tim->RPTCR = first - 1;
+    tim->SWEVGR = TIM_UG;                       // Restart period and load repetition counter
+    tim->RPTCR = second - 1;
+    if (segments == 1) tim->CTLR1 |= TIM_OPM;
+    state->burst_dma = (length != 0);
+    if (length)
     {
-        object->duty_cycle = duty;
+        int ret = start_pwm_dma(iTimer, &tim->RPTCR, list, length, PWM_STREAM_ONESHOT, NULL);
+        if (ret != PWM_OK)
+        {
+            // Counter already holds the first segment, reload 0 and continue as before
+            state->burst_dma = 0;
+            tim->RPTCR = 0;
+            tim->SWEVGR = TIM_UG;
+            tim->CTLR1 = ctlr1;
+            return ret;
+        }
     }
-    // invert for 255 = full on, 0 = full off
-    object->duty_cycle = -(object->duty_cycle - (object->period + 1));
-    TIM_OCInitStructure.TIM_OutputState = TIM_OutputState_Enable;
-	TIM_OCInitStructure.TIM_Pulse = object->duty_cycle;
-	TIM_OCInitStructure.TIM_OCPolarity = TIM_OCPolarity_High;
-    // ---------- Configure Timer and Channel ----------
-    // This extensive selection matrix, should get optimized to few statements by compiler
-    switch (object->timer)
+
+    // ---------- Count segments in update interrupt and start ----------
+    state->burst_callback = callback;
+    state->burst_left = segments;
+    update_pwm_irq(iTimer);
+    tim->CTLR1 |= TIM_CEN;
+    return PWM_OK;
+}
+
+/*********************************************************************
+ * @fn      check_pwm_burst
+ *
+ * @brief   Check if a burst can be started on a timer
+ * 
+ * @param   iTimer      Timer (PWM_TIM1)
+ *
+ * @return  PWM_OK if possible, PWM_ERR_TIMER if not TIM1 or no channel is initialized, PWM_ERR_RANGE if
+ *          center-aligned, PWM_ERR_BUSY if a burst, frequency dithering or a DMA stream of the timer is running
+ */
+static int check_pwm_burst(uint8_t iTimer)
+{
+    if (iTimer != PWM_TIM1 || get_pwm_timer(iTimer) == NULL) return PWM_ERR_TIMER;     // Only TIM1 has a repetition counter
+    PWM_timer_state *state = &pwm_timer_state[iTimer];
+    uint8_t used = 0;
+    for (uint8_t i = 0; i < 4; i++) used |= (state->channels[i] != NULL);
+    if (!used) return PWM_ERR_TIMER;
+    if (state->center) return PWM_ERR_RANGE;
+    if (state->burst_left != 0 || state->arr_den != 0 || is_pwm_stream_active(iTimer)) return PWM_ERR_BUSY;
+    return PWM_OK;
+}
+
+/*********************************************************************
+ * @fn      start_pwm_pulses
+ *
+ * @brief   Emit exactly a number of PWM periods on all enabled channels of TIM1, then stop the timer
+ *          (e.g. ultrasonic transducer bursts or stepper moves). Up to 256 periods run in one-pulse
+ *          mode with the repetition counter without any CPU load. Longer bursts are chained from
+ *          segments of 256 periods, the update interrupt runs once per segment to count them and has
+ *          the whole last segment to arm one-pulse mode, so the count stays exact. Requires forwarding
+ *          TIM1_UP_IRQHandler to pwm_irq_handler(). The burst restarts the period, afterwards the
+ *          counter stands at 0 (outputs inactive unless at 100% duty cycle) until stop_pwm_burst().
+ * 
+ * @param   iTimer      Timer (PWM_TIM1)
+ * @param   pulses      Number of periods (at least 1)
+ * @param   callback    Function called from pwm_irq_handler() when the last period ended (NULL = none)
+ *
+ * @return  PWM_OK on success, PWM_ERR_TIMER if not TIM1 or no channel is initialized, PWM_ERR_RANGE if
+ *          pulses is 0 or the timer is center-aligned, PWM_ERR_BUSY if a burst, frequency dithering or a DMA
+ *          stream of the timer is running
+ */
+int start_pwm_pulses(uint8_t iTimer, uint32_t pulses, pwm_burst_callback callback)
+{
+    int ret = check_pwm_burst(iTimer);
+    if (ret != PWM_OK) return ret;
+    if (pulses == 0) return PWM_ERR_RANGE;
+    uint32_t segments = pulses / 256 + ((pulses & 0xFF) != 0);     // Rounded up, no overflow near 2^32
+    uint16_t first = (uint16_t)(pulses - (segments - 1) * 256);  // Short segment first, RPTCR keeps 255 for the rest
+    return start_pwm_segments(iTimer, first, 256, NULL, 0, segments, callback);
+}
+
+/*********************************************************************
+ * @fn      start_pwm_burst
+ *
+ * @brief   Emit a sequence of back-to-back bursts on all enabled channels of TIM1, then stop the timer.
+ *          Each burst of 1 - 256 periods is one repetition counter cycle and ends with an update event
+ *          (e.g. to change duty cycles by preload or update callback between bursts). The lengths from
+ *          the third burst on are copied into a buffer of the library (PWM_BURST_MAX_COUNT) and streamed
+ *          into the repetition counter by DMA. The update interrupt counts the bursts and arms one-pulse mode during the
+ *          last one, which therefore should last longer than the interrupt latency. Requires forwarding
+ *          TIM1_UP_IRQHandler to pwm_irq_handler().
+ * 
+ * @param   iTimer      Timer (PWM_TIM1)
+ * @param   lengths     Periods per burst (1 - 256), not modified and not needed after the call
+ * @param   count       Number of bursts (1 - PWM_BURST_MAX_COUNT)
+ * @param   callback    Function called from pwm_irq_handler() when the last period ended (NULL = none)
+ *
+ * @return  PWM_OK on success, PWM_ERR_TIMER if not TIM1 or no channel is initialized, PWM_ERR_RANGE if
+ *          count is 0 or too large, a length is invalid or the timer is center-aligned, PWM_ERR_BUSY if a burst,
+ *          frequency dithering or a DMA stream of the timer is running
+ */
+int start_pwm_burst(uint8_t iTimer, const uint16_t *lengths, uint16_t count, pwm_burst_callback callback)
+{
+    int ret = check_pwm_burst(iTimer);
+    if (ret != PWM_OK) return ret;
+    if (lengths == NULL || count == 0) return PWM_ERR_RANGE;
+    for (uint16_t i = 0; i < count; i++)
     {
-        case PWM_TIM1:
-            switch (object->channel)
-            {
-                case PWM_CH1:
-                    TIM_OC1Init( TIM1, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM1, ENABLE );
-                    TIM_OC1PreloadConfig( TIM1, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM1, ENABLE );
-                    break;
-                case PWM_CH2:
-                    TIM_OC2Init( TIM1, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM1, ENABLE );
-                    TIM_OC2PreloadConfig( TIM1, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM1, ENABLE );
-                    break;
-                case PWM_CH3:
-                    TIM_OC3Init( TIM1, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM1, ENABLE );
-                    TIM_OC3PreloadConfig( TIM1, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM1, ENABLE );
-                    break;
-                case PWM_CH4:
-                    TIM_OC4Init( TIM1, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM1, ENABLE );
-                    TIM_OC4PreloadConfig( TIM1, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM1, ENABLE );
-                    break;
-            }
-            break;
-        case PWM_TIM2:
-            switch (object->channel)
-            {
-                case PWM_CH1:
-                    TIM_OC1Init( TIM2, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM2, ENABLE );
-                    TIM_OC1PreloadConfig( TIM2, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM2, ENABLE );
-                    break;
-                case PWM_CH2:
-                    TIM_OC2Init( TIM2, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM2, ENABLE );
-                    TIM_OC2PreloadConfig( TIM2, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM2, ENABLE );
-                    break;
-                case PWM_CH3:
-                    TIM_OC3Init( TIM2, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM2, ENABLE );
-                    TIM_OC3PreloadConfig( TIM2, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM2, ENABLE );
-                    break;
-                case PWM_CH4:
-                    TIM_OC4Init( TIM2, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM2, ENABLE );
-                    TIM_OC4PreloadConfig( TIM2, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM2, ENABLE );
-                    break;
-            }
-            break;
-        case PWM_TIM3:
-            switch (object->channel)
-            {
-                case PWM_CH1:
-                    TIM_OC1Init( TIM3, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM3, ENABLE );
-                    TIM_OC1PreloadConfig( TIM3, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM3, ENABLE );
-                    break;
-                case PWM_CH2:
-                    TIM_OC2Init( TIM3, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM3, ENABLE );
-                    TIM_OC2PreloadConfig( TIM3, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM3, ENABLE );
-                    break;
-                case PWM_CH3:
-                    TIM_OC3Init( TIM3, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM3, ENABLE );
-                    TIM_OC3PreloadConfig( TIM3, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM3, ENABLE );
-                    break;
-                case PWM_CH4:
-                    TIM_OC4Init( TIM3, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM3, ENABLE );
-                    TIM_OC4PreloadConfig( TIM3, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM3, ENABLE );
-                    break;
-            }
-            break;
-        #if !defined(CH32X035) && !defined(CH32X033)
-        case PWM_TIM4:
-            switch (object->channel)
-            {
-                case PWM_CH1:
-                    TIM_OC1Init( TIM4, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM4, ENABLE );
-                    TIM_OC1PreloadConfig( TIM4, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM4, ENABLE );
-                    break;
-                case PWM_CH2:
-                    TIM_OC2Init( TIM4, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM4, ENABLE );
-                    TIM_OC2PreloadConfig( TIM4, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM4, ENABLE );
-                    break;
-                case PWM_CH3:
-                    TIM_OC3Init( TIM4, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM4, ENABLE );
-                    TIM_OC3PreloadConfig( TIM4, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM4, ENABLE );
-                    break;
-                case PWM_CH4:
-                    TIM_OC4Init( TIM4, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM4, ENABLE );
-                    TIM_OC4PreloadConfig( TIM4, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM4, ENABLE );
-                    break;
-            }
-            break;
-        #endif
+        if (lengths[i] == 0 || lengths[i] > 256) return PWM_ERR_RANGE;
     }
+    if (count > PWM_BURST_MAX_COUNT) return PWM_ERR_RANGE;
+    for (uint16_t i = 2; i < count; i++) pwm_burst_rptcr[i - 2] = lengths[i] - 1;
+    return start_pwm_segments(iTimer, lengths[0], (count > 1) ? lengths[1] : lengths[0], pwm_burst_rptcr, (count > 2) ? count - 2 : 0, count, callback);
 }
 
 /*********************************************************************
- * @fn      enable_pwm_output
+ * @fn      end_pwm_burst
  *
- * @brief   Enable PWM output
+ * @brief   Release repetition counter, one-pulse mode and DMA of a finished or aborted burst
  * 
- * @param   object      Pointer to PWM_handle struct to enable output of
+ * @param   iTimer      Timer (PWM_TIM1)
  *
  * @return  None
  */
-void enable_pwm_output(PWM_handle *object)
+static void end_pwm_burst(uint8_t iTimer)
 {
-    // ---------- Enable timer ----------
-    // ---------- Re-Initialize base structure with TIM_OutputState_Enable ----------
-    TIM_OCInitTypeDef TIM_OCInitStructure={0};
+    TIM_TypeDef *tim = get_pwm_timer(iTimer);
+    PWM_timer_state *state = &pwm_timer_state[iTimer];
+    if (state->burst_dma) stop_pwm_stream(iTimer);
+    state->burst_dma = 0;
+    state->burst_left = 0;
+    tim->CTLR1 &= (uint16_t)~(TIM_OPM | TIM_URS);
+    tim->RPTCR = 0;
+    update_pwm_irq(iTimer);
+}
+
+/*********************************************************************
+ * @fn      stop_pwm_burst
+ *
+ * @brief   Abort a running burst immediately or resume continuous operation after a burst ended.
+ *          The period restarts, the callback is not called.
+ * 
+ * @param   iTimer      Timer (PWM_TIM1)
+ *
+ * @return  None
+ */
+void stop_pwm_burst(uint8_t iTimer)
+{
+    TIM_TypeDef *tim = get_pwm_timer(iTimer);
+    if (iTimer != PWM_TIM1 || tim == NULL) return;
+    end_pwm_burst(iTimer);
+    tim->SWEVGR = TIM_UG;
+    TIM_Cmd(tim, ENABLE);
+}
 
-    if (object->pwm_mode == PWM_MODE1)
+/*********************************************************************
+ * @fn      is_pwm_update_pending
+ *
+ * @brief   Check if the last preloaded duty cycle is not yet live.
+ *          Without update callback, the timer's update flag is polled,
+ *          which may report the new value live up to one period late.
+ * 
+ * @param   object      Pointer to PWM_handle struct to check
+ *
+ * @return  1 if the new duty cycle waits for the next update event, else 0
+ */
+uint8_t is_pwm_update_pending(PWM_handle *object)
+{
+    if (object->update_pending && !(object->tim->DMAINTENR & TIM_UIE) && (object->tim->INTFR & TIM_UIF))
     {
-        TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_PWM1;
+        object->update_pending = 0;
     }
-    else
+    return object->update_pending;
+}
+
+/*********************************************************************
+ * @fn      update_pwm_irq
+ *
+ * @brief   Enable the update interrupt of a timer while it has an update callback, channels or
+ *          a period dithered by the update interrupt or a running burst, disable it otherwise.
+ * 
+ * @param   iTimer      Timer (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ *
+ * @return  None
+ */
+static void update_pwm_irq(uint8_t iTimer)
+{
+    TIM_TypeDef *tim = get_pwm_timer(iTimer);
+    PWM_timer_state *state = &pwm_timer_state[iTimer];
+    uint8_t needed = (state->update_callback != NULL) || (state->arr_den != 0 && state->arr_table == NULL) || (state->burst_left != 0) || (state->capture != NULL);
+    for (uint8_t i = 0; i < 4; i++)
     {
-        TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_PWM2;
+        PWM_handle *h = state->channels[i];
+        if (h && h->dither_bits && h->dither_table == NULL) needed = 1;
     }
-    TIM_OCInitStructure.TIM_OutputState = TIM_OutputState_Enable;       // Ensure PWM-Output is turned on
-	TIM_OCInitStructure.TIM_Pulse = object->duty_cycle;
-	TIM_OCInitStructure.TIM_OCPolarity = TIM_OCPolarity_High;
-    // ---------- Configure Timer and Channel ----------
-    // This extensive selection matrix, should get optimized to few statements by compiler
-    switch (object->timer)
+    if (needed == ((tim->DMAINTENR & TIM_UIE) != 0)) return;
+    TIM_ClearITPendingBit(tim, TIM_IT_Update);
+    TIM_ITConfig(tim, TIM_IT_Update, needed ? ENABLE : DISABLE);
+    if (needed)
     {
-        case PWM_TIM1:
-            switch (object->channel)
-            {
-                case PWM_CH1:
-                    TIM_OC1Init( TIM1, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM1, ENABLE );
-                    TIM_OC1PreloadConfig( TIM1, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM1, ENABLE );
-                    break;
-                case PWM_CH2:
-                    TIM_OC2Init( TIM1, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM1, ENABLE );
-                    TIM_OC2PreloadConfig( TIM1, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM1, ENABLE );
-                    break;
-                case PWM_CH3:
-                    TIM_OC3Init( TIM1, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM1, ENABLE );
-                    TIM_OC3PreloadConfig( TIM1, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM1, ENABLE );
-                    break;
-                case PWM_CH4:
-                    TIM_OC4Init( TIM1, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM1, ENABLE );
-                    TIM_OC4PreloadConfig( TIM1, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM1, ENABLE );
-                    break;
-            }
-            break;
-        case PWM_TIM2:
-            switch (object->channel)
-            {
-                case PWM_CH1:
-                    TIM_OC1Init( TIM2, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM2, ENABLE );
-                    TIM_OC1PreloadConfig( TIM2, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM2, ENABLE );
-                    break;
-                case PWM_CH2:
-                    TIM_OC2Init( TIM2, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM2, ENABLE );
-                    TIM_OC2PreloadConfig( TIM2, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM2, ENABLE );
-                    break;
-                case PWM_CH3:
-                    TIM_OC3Init( TIM2, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM2, ENABLE );
-                    TIM_OC3PreloadConfig( TIM2, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM2, ENABLE );
-                    break;
-                case PWM_CH4:
-                    TIM_OC4Init( TIM2, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM2, ENABLE );
-                    TIM_OC4PreloadConfig( TIM2, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM2, ENABLE );
-                    break;
-            }
-            break;
-        case PWM_TIM3:
-            switch (object->channel)
-            {
-                case PWM_CH1:
-                    TIM_OC1Init( TIM3, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM3, ENABLE );
-                    TIM_OC1PreloadConfig( TIM3, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM3, ENABLE );
-                    break;
-                case PWM_CH2:
-                    TIM_OC2Init( TIM3, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM3, ENABLE );
-                    TIM_OC2PreloadConfig( TIM3, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM3, ENABLE );
-                    break;
-                case PWM_CH3:
-                    TIM_OC3Init( TIM3, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM3, ENABLE );
-                    TIM_OC3PreloadConfig( TIM3, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM3, ENABLE );
-                    break;
-                case PWM_CH4:
-                    TIM_OC4Init( TIM3, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM3, ENABLE );
-                    TIM_OC4PreloadConfig( TIM3, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM3, ENABLE );
-                    break;
-            }
-            break;
-        #if !defined(CH32X035) && !defined(CH32X033)
-        case PWM_TIM4:
-            switch (object->channel)
-            {
-                case PWM_CH1:
-                    TIM_OC1Init( TIM4, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM4, ENABLE );
-                    TIM_OC1PreloadConfig( TIM4, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM4, ENABLE );
-                    break;
-                case PWM_CH2:
-                    TIM_OC2Init( TIM4, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM4, ENABLE );
-                    TIM_OC2PreloadConfig( TIM4, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM4, ENABLE );
-                    break;
-                case PWM_CH3:
-                    TIM_OC3Init( TIM4, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM4, ENABLE );
-                    TIM_OC3PreloadConfig( TIM4, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM4, ENABLE );
-                    break;
-                case PWM_CH4:
-                    TIM_OC4Init( TIM4, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM4, ENABLE );
-                    TIM_OC4PreloadConfig( TIM4, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM4, ENABLE );
-                    break;
-            }
-            break;
-        #endif
+        switch (iTimer)
+        {
+            case PWM_TIM1:
+                NVIC_EnableIRQ(TIM1_UP_IRQn);
+                break;
+            #if defined(CH32X035) || defined(CH32X033)
+            case PWM_TIM2:
+                NVIC_EnableIRQ(TIM2_UP_IRQn);
+                break;
+            #else
+            case PWM_TIM2:
+                NVIC_EnableIRQ(TIM2_IRQn);
+                break;
+            #endif
+            case PWM_TIM3:
+                NVIC_EnableIRQ(TIM3_IRQn);
+                break;
+            #if !defined(CH32X035) && !defined(CH32X033)
+            case PWM_TIM4:
+                NVIC_EnableIRQ(TIM4_IRQn);
+                break;
+            #endif
+        }
     }
 }
 
 /*********************************************************************
- * @fn      disable_pwm_output
+ * @fn      set_pwm_update_callback
  *
- * @brief   Disable PWM output
+ * @brief   Register a callback on update events of a timer and enable its update interrupt.
+ *          The callback is invoked by pwm_irq_handler(), which has to be called from the
+ *          timer's interrupt handler (TIM1_UP_IRQHandler, TIM2_IRQHandler, ...).
  * 
- * @param   object      Pointer to PWM_handle struct to disable output of
+ * @param   iTimer      Timer (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ * @param   callback    Function to call after each update event, NULL to disable update interrupt
  *
  * @return  None
  */
-void disable_pwm_output(PWM_handle *object)
+void set_pwm_update_callback(uint8_t iTimer, pwm_update_callback callback)
 {
-    // ---------- Disable timer ----------
-    // ---------- Re-Initialize base structure with TIM_OutputState_Disable ----------
-    TIM_OCInitTypeDef TIM_OCInitStructure={0};
+    if (get_pwm_timer(iTimer) == NULL) return;
+    pwm_timer_state[iTimer].update_callback = callback;
+    update_pwm_irq(iTimer);
+}
 
-    if (object->pwm_mode == PWM_MODE1)
-    {
-        TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_PWM1;
-    }
-    else
+/*********************************************************************
+ * @fn      pwm_irq_handler
+ *
+ * @brief   Handle timer interrupt: marks preloaded duty cycles as live and invokes the
+ *          update callback, records break events and invokes the break callback.
+ *          Call this from the timer's interrupt handlers, e.g.
+ *          void TIM1_UP_IRQHandler(void) { pwm_irq_handler(PWM_TIM1); }
+ * 
+ * @param   iTimer      Timer (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ *
+ * @return  None
+ */
+void pwm_irq_handler(uint8_t iTimer)
+{
+    TIM_TypeDef *tim = get_pwm_timer(iTimer);
+    if (tim == NULL) return;
+    PWM_timer_state *state = &pwm_timer_state[iTimer];
+    if ((tim->INTFR & TIM_BIF) && (tim->DMAINTENR & TIM_BIE))
     {
-        TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_PWM2;
+        uint32_t timestamp = PWM_TIMESTAMP();
+        tim->INTFR = (uint16_t)~TIM_BIF;
+        tim->DMAINTENR &= (uint16_t)~TIM_BIE;       // Re-armed by clear_pwm_break(), avoids interrupt storm while fault persists
+        for (uint8_t i = 0; i < 4; i++)
+        {
+            if (state->channels[i])
+            {
+                state->channels[i]->break_count++;
+                state->channels[i]->break_timestamp = timestamp;
+            }
+        }
+        if (state->break_callback) state->break_callback(iTimer);
     }
-    TIM_OCInitStructure.TIM_OutputState = TIM_OutputState_Disable;       // Ensure PWM-Output is turned off
-	TIM_OCInitStructure.TIM_Pulse = object->duty_cycle;
-	TIM_OCInitStructure.TIM_OCPolarity = TIM_OCPolarity_High;
-    // ---------- Configure Timer and Channel ----------
-    // This extensive selection matrix, should get optimized to few statements by compiler
-    switch (object->timer)
+    if ((tim->INTFR & TIM_UIF) && (tim->DMAINTENR & TIM_UIE))
     {
-        case PWM_TIM1:
-            switch (object->channel)
+        tim->INTFR = (uint16_t)~TIM_UIF;
+        if (state->burst_left != 0)
+        {
+            // One update event per repetition counter segment
+            state->burst_left--;
+            if (state->burst_left == 1) tim->CTLR1 |= TIM_OPM;     // Last segment started, stop counter at its end
+            if (state->burst_left == 0)
             {
-                case PWM_CH1:
-                    TIM_OC1Init( TIM1, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM1, ENABLE );
-                    TIM_OC1PreloadConfig( TIM1, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM1, ENABLE );
-                    break;
-                case PWM_CH2:
-                    TIM_OC2Init( TIM1, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM1, ENABLE );
-                    TIM_OC2PreloadConfig( TIM1, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM1, ENABLE );
-                    break;
-                case PWM_CH3:
-                    TIM_OC3Init( TIM1, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM1, ENABLE );
-                    TIM_OC3PreloadConfig( TIM1, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM1, ENABLE );
-                    break;
-                case PWM_CH4:
-                    TIM_OC4Init( TIM1, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM1, ENABLE );
-                    TIM_OC4PreloadConfig( TIM1, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM1, ENABLE );
-                    break;
+                end_pwm_burst(iTimer);
+                if (state->burst_callback) state->burst_callback(iTimer);
             }
-            break;
-        case PWM_TIM2:
-            switch (object->channel)
+        }
+        if (state->arr_den != 0 && state->arr_table == NULL)
+        {
+            // Sigma-delta: one count longer period whenever the accumulated fraction overflows
+            state->arr_acc += state->arr_frac;
+            if (state->arr_acc >= state->arr_den)
             {
-                case PWM_CH1:
-                    TIM_OC1Init( TIM2, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM2, ENABLE );
-                    TIM_OC1PreloadConfig( TIM2, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM2, ENABLE );
-                    break;
-                case PWM_CH2:
-                    TIM_OC2Init( TIM2, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM2, ENABLE );
-                    TIM_OC2PreloadConfig( TIM2, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM2, ENABLE );
-                    break;
-                case PWM_CH3:
-                    TIM_OC3Init( TIM2, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM2, ENABLE );
-                    TIM_OC3PreloadConfig( TIM2, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM2, ENABLE );
-                    break;
-                case PWM_CH4:
-                    TIM_OC4Init( TIM2, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM2, ENABLE );
-                    TIM_OC4PreloadConfig( TIM2, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM2, ENABLE );
-                    break;
+                state->arr_acc -= state->arr_den;
+                tim->ATRLR = state->arr + state->center + 1;
             }
-            break;
-        case PWM_TIM3:
-            switch (object->channel)
+            else
             {
-                case PWM_CH1:
-                    TIM_OC1Init( TIM3, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM3, ENABLE );
-                    TIM_OC1PreloadConfig( TIM3, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM3, ENABLE );
-                    break;
-                case PWM_CH2:
-                    TIM_OC2Init( TIM3, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM3, ENABLE );
-                    TIM_OC2PreloadConfig( TIM3, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM3, ENABLE );
-                    break;
-                case PWM_CH3:
-                    TIM_OC3Init( TIM3, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM3, ENABLE );
-                    TIM_OC3PreloadConfig( TIM3, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM3, ENABLE );
-                    break;
-                case PWM_CH4:
-                    TIM_OC4Init( TIM3, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM3, ENABLE );
-                    TIM_OC4PreloadConfig( TIM3, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM3, ENABLE );
-                    break;
+                tim->ATRLR = state->arr + state->center;
             }
-            break;
-        #if !defined(CH32X035) && !defined(CH32X033)
-        case PWM_TIM4:
-            switch (object->channel)
+        }
+        for (uint8_t i = 0; i < 4; i++)
+        {
+            PWM_handle *h = state->channels[i];
+            if (h == NULL) continue;
+            h->update_pending = 0;
+            if (h->dither_bits && h->dither_table == NULL)
             {
-                case PWM_CH1:
-                    TIM_OC1Init( TIM4, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM4, ENABLE );
-                    TIM_OC1PreloadConfig( TIM4, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM4, ENABLE );
-                    break;
-                case PWM_CH2:
-                    TIM_OC2Init( TIM4, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM4, ENABLE );
-                    TIM_OC2PreloadConfig( TIM4, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM4, ENABLE );
-                    break;
-                case PWM_CH3:
-                    TIM_OC3Init( TIM4, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM4, ENABLE );
-                    TIM_OC3PreloadConfig( TIM4, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM4, ENABLE );
-                    break;
-                case PWM_CH4:
-                    TIM_OC4Init( TIM4, &TIM_OCInitStructure );
-                    TIM_CtrlPWMOutputs( TIM4, ENABLE );
-                    TIM_OC4PreloadConfig( TIM4, TIM_OCPreload_Disable );
-                    TIM_ARRPreloadConfig( TIM4, ENABLE );
-                    break;
+                // Sigma-delta: one count more whenever the accumulated fraction overflows
+                uint8_t acc = h->dither_acc + h->dither_frac;
+                *h->ccr = h->duty_cycle - (acc >> h->dither_bits);
+                h->dither_acc = acc & ((1 << h->dither_bits) - 1);
             }
-            break;
-        #endif
+        }
+        if (state->capture)
+        {
+            // No rising edge for 65536 ticks: input slower than f_min or stopped, next capture is no full period
+            PWM_capture *cap = state->capture;
+            cap->sample = 0;
+            cap->jitter = 0;
+            cap->last = 0;
+            cap->peak = 0;
+            cap->window = 0;
+            cap->sync = 0;
+        }
+        if (state->update_callback) state->update_callback(iTimer);
+    }
+    PWM_capture *cap = state->capture;
+    uint16_t cc_flag = (cap && cap->channel == PWM_CH2) ? TIM_CC2IF : TIM_CC1IF;
+    if (cap && (tim->INTFR & cc_flag))
+    {
+        // Rising edge captured the period and reset the counter, the falling edge before it captured the high time
+        tim->INTFR = (uint16_t)~cc_flag;
+        uint16_t period = (cap->channel == PWM_CH1) ? tim->CH1CVR : tim->CH2CVR;
+        uint16_t high = (cap->channel == PWM_CH1) ? tim->CH2CVR : tim->CH1CVR;
+        if (cap->sync && period != 0)
+        {
+            if (high > period) high = period;
+            cap->sample = ((uint32_t)high << 16) | period;
+            if (cap->last)
+            {
+                uint16_t change = (period > cap->last) ? period - cap->last : cap->last - period;
+                if (change > cap->peak) cap->peak = change;
+            }
+            cap->last = period;
+            if (++cap->window >= PWM_CAPTURE_WINDOW)
+            {
+                cap->jitter = cap->peak;
+                cap->peak = 0;
+                cap->window = 0;
+            }
+            cap->count++;
+        }
+        cap->sync = 1;
     }
-}
\ No newline at end of file
+}
@@ -36,6 +36,50 @@ extern "C" {
 
 #include "debug.h"
 
+/* ++++++++++++++++++++ USER CONFIG AREA BEGIN ++++++++++++++++++++ */
+
+#define PWM_SOLVER_MAX_STEPS    1024                /* Maximum number of prescaler candidates the frequency solver tries (bounds init time at low frequencies) */
+#define PWM_FREQ_POLICY         PWM_FREQ_REJECT     /* Default handling of channels requesting a different frequency on a shared timer */
+#define PWM_RESERVED_TIMERS     0                   /* Timers not to be used for PWM, e.g. (1 << PWM_TIM2) when using CH32V USB Serial Library (TIM3 on CH32X035) */
+//#define PWM_TIMESTAMP()         ((uint32_t)SysTick->CNT)    /* Timestamp source for break events (must be free running, e.g. SysTick started by user) */
+#define PWM_CAPTURE_WINDOW      64                  /* Number of periods over which input capture takes the peak period jitter */
+#define PWM_BURST_MAX_COUNT     64                  /* Maximum number of bursts per start_pwm_burst() sequence (2 bytes of RAM each) */
+
+/* ++++++++++++++++++++ USER CONFIG AREA END ++++++++++++++++++++ */
+
+#ifndef PWM_SOLVER_MAX_STEPS
+    #define PWM_SOLVER_MAX_STEPS 1024
+#endif
+#ifndef PWM_FREQ_POLICY
+    #define PWM_FREQ_POLICY PWM_FREQ_REJECT
+#endif
+#ifndef PWM_RESERVED_TIMERS
+    #define PWM_RESERVED_TIMERS 0
+#endif
+#ifndef PWM_CAPTURE_WINDOW
+    #define PWM_CAPTURE_WINDOW 64
+#endif
+#ifndef PWM_BURST_MAX_COUNT
+    #define PWM_BURST_MAX_COUNT 64
+#endif
+#ifndef PWM_TIMESTAMP
+    #if defined(CH32V10X)
+        #define PWM_TIMESTAMP() 0
+    #else
+        #define PWM_TIMESTAMP() ((uint32_t)SysTick->CNT)
+    #endif
+#endif
+
+// Return codes
+#define PWM_OK          0       // Success
+#define PWM_ERR_PIN     -1      // Invalid pin specified
+#define PWM_ERR_FREQ    -2      // Frequency not reachable with requested resolution
+#define PWM_ERR_TIMER   -3      // Invalid timer or channel specified
+#define PWM_ERR_RANGE   -4      // Parameter out of range
+#define PWM_ERR_BUSY    -5      // Timer, channel or pin already in use
+#define PWM_ERR_CONFLICT -6     // Timer already runs at an incompatible frequency
+#define PWM_ERR_TIMEOUT -7      // Hardware did not respond in time
+
 // PWM Timers
 #define PWM_TIM1    1
 #define PWM_TIM2    2
@@ -52,6 +96,33 @@ extern "C" {
 #define PWM_MODE1   0
 #define PWM_MODE2   1
 
+// Frequency arbitration policy for channels sharing a timer
+#define PWM_FREQ_REJECT     1   // Reject channels with incompatible frequency (PWM_ERR_CONFLICT)
+#define PWM_FREQ_RESCALE    2   // Retune timer to new frequency, keep duty ratios of existing channels
+
+// Timer counting modes
+#define PWM_COUNT_UP        0   // Edge-aligned, counter runs up to ARR and restarts at 0
+#define PWM_COUNT_CENTER1   1   // Center-aligned (up and down), compare flags set while counting down
+#define PWM_COUNT_CENTER2   2   // Center-aligned, compare flags set while counting up
+#define PWM_COUNT_CENTER3   3   // Center-aligned, compare flags set while counting up and down
+
+// Update events of center-aligned timers
+#define PWM_UPDATE_BOTH     0   // At top and bottom of the count (twice per period)
+#define PWM_UPDATE_TOP      1   // At top only (TIM1, repetition counter)
+#define PWM_UPDATE_BOTTOM   2   // At bottom only (TIM1, repetition counter)
+
+// iCount of init_pwm() to use the longest timer period the frequency allows
+#define PWM_RESOLUTION_MAX  0xFFFF
+
+// Timer time base (result of frequency solver)
+typedef struct
+{
+    uint16_t prescaler;     // PSC register value (clock divider - 1)
+    uint16_t arr;           // ATRLR register value (counts per period - 1)
+    uint32_t f_actual;      // Achieved frequency in Hz (rounded)
+    int32_t f_error_ppm;    // Deviation of achieved from requested frequency in ppm
+} PWM_timebase;
+
 // PWM Object handler struct
 typedef struct
 {
@@ -59,10 +130,76 @@ typedef struct
     uint8_t timer;          // Timer
     uint8_t channel;        // Channel of Timer
     uint16_t prescaler;     // Prescaler of Timer
-    uint16_t period;        // Max. counter of Timer PWM output
-    uint16_t duty_cycle;    // Duty Cycle of PWM output
+    uint16_t period;        // Duty cycle scale (max. duty = period + 1)
+    uint16_t duty_cycle;    // Duty Cycle of PWM output (compare register value)
+    uint16_t arr;           // Max. counter of Timer PWM output (>= period)
+    uint32_t duty_scale;    // Q16 factor from duty scale to timer counts, (arr + 1) / (period + 1)
+    uint32_t f_base;        // Requested carrier frequency in Hz (rounded, at least 1 on cascaded timers)
+    uint32_t f_actual;      // Achieved carrier frequency in Hz (rounded)
+    int32_t f_error_ppm;    // Deviation of achieved from requested frequency in ppm
+    uint32_t f_avg_millihz; // Long-term average carrier frequency in mHz (0xFFFFFFFF above 4.29MHz)
+    uint32_t jitter_ps;     // Peak cycle-to-cycle period jitter in ps (frequency dithering, else 0)
+    TIM_TypeDef *tim;       // Registers of Timer (resolved at init)
+    __IO uint16_t *ccr;     // Compare register of Channel (resolved at init)
+    uint16_t ccer_mask;     // Output enable bit of Channel in CCER
+    uint16_t pin;           // Output pin claimed by this handle
+    uint16_t pin_n;         // Complementary output pin claimed by this handle (0 = none)
+    uint32_t remap;         // AFIO remap bits the pin depends on, see PWM_REMAP() (0 = none)
+    uint8_t preload;        // Compare register preload active (duty changes at next update event)
+    volatile uint8_t update_pending;    // Preloaded duty cycle written, but not yet live
+    volatile uint32_t break_count;      // Number of break events (fault shutdowns) of Timer
+    volatile uint32_t break_timestamp;  // PWM_TIMESTAMP() of last break event
+    uint8_t dither_bits;    // Fractional duty cycle bits added by dithering (0 = off)
+    uint8_t dither_frac;    // Fractional part of duty cycle in 1 / 2^dither_bits counts
+    uint8_t dither_acc;     // Sigma-delta accumulator of update interrupt dithering
+    uint16_t *dither_table; // Compare value sequence streamed by DMA (NULL = update interrupt dithering)
 } PWM_handle;
 
+// PWM input measurement on channel 1 or 2 of a timer, written by pwm_irq_handler(), read by read_pwm_capture()
+typedef struct
+{
+    uint8_t timer;          // Timer
+    uint8_t channel;        // Channel of Timer with the input pin (PWM_CH1 or PWM_CH2)
+    uint16_t pin;           // Input pin claimed by this measurement
+    uint32_t divider;       // Prescaler divider (PSC + 1), counter ticks = SystemCoreClock / divider
+    volatile uint32_t sample;   // Last period (bits 0 - 15) and high time (bits 16 - 31) in ticks, one word so it is read atomically (0 = no signal)
+    volatile uint32_t jitter;   // Peak cycle-to-cycle period change of the last PWM_CAPTURE_WINDOW periods in ticks
+    volatile uint32_t count;    // Number of measured periods
+    uint16_t last;          // Previous period in ticks (0 = none, ISR only)
+    uint16_t peak;          // Peak period change of the running window in ticks (ISR only)
+    uint16_t window;        // Periods measured in the running window (ISR only)
+    uint8_t sync;           // Counter was reset by an edge, next capture is a full period (ISR only)
+} PWM_capture;
+
+// Reading of a PWM input
+typedef struct
+{
+    uint32_t f_millihz;     // Frequency in mHz (0 = no edge within 1 / f_min)
+    uint32_t duty_q16;      // High time per period, 65536 = 100% (input level if there is no signal)
+    uint32_t jitter_ns;     // Peak cycle-to-cycle period change of the last PWM_CAPTURE_WINDOW periods in ns
+    uint32_t count;         // Number of measured periods
+} PWM_capture_value;
+
+// Callback for timer update events, receives timer number (PWM_TIM1, ...)
+typedef void (*pwm_update_callback)(uint8_t iTimer);
+// Callback for timer break events (fault shutdown), receives timer number (PWM_TIM1)
+typedef void (*pwm_break_callback)(uint8_t iTimer);
+// Callback for the end of a pulse burst, receives timer number (PWM_TIM1)
+typedef void (*pwm_burst_callback)(uint8_t iTimer);
+
+// Get register block of a timer (NULL if not available)
+TIM_TypeDef *get_pwm_timer(uint8_t iTimer);
+// Find prescaler/period pair for a frequency with at least min_count + 1 counts per period
+int solve_pwm_timebase(PWM_timebase *tb, uint32_t f_clk, uint32_t iF_base, uint16_t min_count);
+// Find highest resolution in bits (>= min_bits) for a frequency and the most accurate prescaler/period pair keeping it
+int plan_pwm_timebase(PWM_timebase *tb, uint32_t f_clk, uint32_t iF_base, uint8_t min_bits);
+// Calculate achieved frequency and error of a prescaler/period pair
+void eval_pwm_timebase(PWM_timebase *tb, uint32_t f_clk, uint32_t iF_base);
+// Get clock the period of a timer is counted in (SystemCoreClock / 2 for center-aligned timers)
+uint32_t get_pwm_clock(uint8_t iTimer);
+// Get number of update events per period of a timer (2 for center-aligned timers updating at top and bottom)
+uint8_t get_pwm_updates(uint8_t iTimer);
+
 // Initializer function for PWM_handle (also let iCount default to 254 and iPwm_mode to PWM_MODE2 if not specified)
 int init_pwm_base(PWM_handle *object, uint8_t iTimer, uint8_t iChannel, uint16_t u16Pin, uint32_t iF_base, uint16_t iCount, uint16_t iPwm_mode);
 // input structure for variadic args
@@ -88,21 +225,151 @@ int var_init_pwm(init_pwm_args in);
  * @param   iChannel    Channel of time to use for PWM (PWM_CH1, PWM_CH2, PWM_CH3 or PWM_CH4)
  * @param   u16Pin      Pin for outputting PWM signal (e.g 0x0A08 for PA8 ...)
  * @param   iF_base     Base carrier frequency of PWM signal (e.g. 40000 = 40kHz)
- * @param   iCount      Base for scaling duty cycle (max = iCount + 1, min = 0) (e.g. 254 for 8-Bit resolution)
+ * @param   iCount      Base for scaling duty cycle (max = iCount + 1, min = 0) (e.g. 254 for 8-Bit resolution),
+ *                      PWM_RESOLUTION_MAX for the longest timer period the frequency allows (scale in object->period)
  * @param   iPwm_mode   PWM mode selection, changes precision of actual output (PWM_MODE1 or PWM_MODE2)
  *
- * @return  Normally returns 0 on exit, returns -1 if invalid pin specified
+ * @return  PWM_OK on success, PWM_ERR_PIN if invalid pin specified, PWM_ERR_FREQ if frequency is not reachable,
+ *          PWM_ERR_TIMER if invalid timer or channel specified
+ */
+#define init_pwm(...) var_init_pwm((init_pwm_args){__VA_ARGS__})
+// input structure for variadic args of pin based initialization
+typedef struct 
+{
+    PWM_handle *object;
+    uint8_t iTimer;
+    uint8_t iChannel;
+    uint16_t u16Pin;
+    uint32_t remap;
+    uint32_t iF_base;
+    uint16_t iCount;
+    uint16_t iPwm_mode;
+} init_pwm_pin_args;
+// placeholder for default args
+int var_init_pwm_pin(init_pwm_pin_args in);
+/*********************************************************************
+ * @fn      init_pwm_pin
+ *
+ * @brief   Initialize handler for PWM structure by pin name only. Timer, channel and AFIO remap
+ *          are taken from the constant tables in ch32v_pwm_pins.h, pins without PWM function fail to compile.
+ *          Not available on CH32X035/X033 (no pin table yet), fails to compile there.
+ * 
+ * @param   object      Pointer to PWM_handle struct to initialize
+ * @param   pin         Pin name (e.g. PA8, PB4, ...)
+ * @param   iF_base     Base carrier frequency of PWM signal (e.g. 40000 = 40kHz)
+ * @param   iCount      Base for scaling duty cycle (default 254)
+ * @param   iPwm_mode   PWM mode selection (default PWM_MODE2)
+ *
+ * @return  PWM_OK on success, PWM_ERR_FREQ if frequency is not reachable, PWM_ERR_BUSY if timer, channel or pin
+ *          already in use or the remap contradicts another channel of the timer, PWM_ERR_CONFLICT on frequency conflict
+ */
+#if defined(CH32X035) || defined(CH32X033)
+#define init_pwm_pin(object, pin, ...) ({ _Static_assert(0, "init_pwm_pin(): no pin table for CH32X035/X033, use init_pwm()"); PWM_ERR_PIN; })
+#else
+#define init_pwm_pin(object, pin, ...) var_init_pwm_pin((init_pwm_pin_args){object, PWM_PIN_##pin, __VA_ARGS__})
+#endif
+// input structure for variadic args of automatic placement
+typedef struct 
+{
+    PWM_handle *object;
+    uint32_t iF_base;
+    uint16_t iCount;
+    uint16_t iPwm_mode;
+} init_pwm_any_args;
+// placeholder for default args
+int var_init_pwm_any(init_pwm_any_args in);
+/*********************************************************************
+ * @fn      init_pwm_any
+ *
+ * @brief   Initialize handler for PWM structure on any free timer channel and its default pin.
+ *          Channels with the same frequency are packed onto shared timers.
+ * 
+ * @param   object      Pointer to PWM_handle struct to initialize
+ * @param   iF_base     Base carrier frequency of PWM signal (e.g. 40000 = 40kHz)
+ * @param   iCount      Base for scaling duty cycle (default 254)
+ * @param   iPwm_mode   PWM mode selection (default PWM_MODE2)
+ *
+ * @return  PWM_OK on success, PWM_ERR_BUSY if no free channel is left, PWM_ERR_FREQ if frequency is not reachable,
+ *          PWM_ERR_PIN on CH32X035/X033 (no default pins mapped yet)
  */
-#define init_pwm(...) var_init_pwm((init_pwm_args){__VA_ARGS__});
-// Function to set/update duty cycle
+#define init_pwm_any(...) var_init_pwm_any((init_pwm_any_args){__VA_ARGS__})
+// Function to initialize a PWM channel clocked by the update events of a master timer (frequency in mHz, periods up to 2^48 clock cycles)
+extern int init_pwm_cascade(PWM_handle *object, uint8_t iMaster, uint8_t iTimer, uint8_t iChannel, uint16_t u16Pin, uint32_t f_millihz, uint16_t iCount, uint16_t iPwm_mode);
+// Function to check if a timer is clocked by a master timer
+extern uint8_t is_pwm_cascaded(uint8_t iTimer);
+// Function to release timer channel and pin of a PWM object
+extern void release_pwm(PWM_handle *object);
+// Function to select how a timer handles channels requesting a different frequency
+extern void set_pwm_freq_policy(uint8_t iTimer, uint8_t policy);
+// Function to select edge- or center-aligned counting of a timer, keeping its frequency
+extern int set_pwm_counter_mode(uint8_t iTimer, uint8_t mode, uint8_t update);
+// Function to change the frequency of a running timer at its next update event, keeping duty ratios (leaves compare preload enabled)
+extern int set_pwm_frequency(uint8_t iTimer, uint32_t iF_base);
+// Function to exclude a timer from PWM use (e.g. used by other libraries)
+extern int reserve_pwm_timer(uint8_t iTimer);
+// Function to convert a duty cycle to the compare register value of a PWM object
+extern uint16_t calc_pwm_compare(PWM_handle *object, uint16_t duty);
+// Function to convert a Q16 duty cycle fraction (65536 = always on) to the compare register value of a PWM object
+extern uint16_t calc_pwm_compare_q16(PWM_handle *object, uint32_t duty);
+// Function to set/update duty cycle (single compare register write, does not re-enable a disabled output)
 extern void set_pwm_dutycycle(PWM_handle *object, uint16_t duty);
+// Function to set/update duty cycle as Q16 fraction of the period, independent of iCount (65536 = always on)
+extern void set_pwm_dutycycle_q16(PWM_handle *object, uint32_t duty);
+// Function to set the compare register value directly, tracking its preload like set_pwm_dutycycle()
+extern void set_pwm_compare(PWM_handle *object, uint16_t compare);
 // Function to enable PWM output
 extern void enable_pwm_output(PWM_handle *object);
 // Function to disable PWM output
 extern void disable_pwm_output(PWM_handle *object);
+// Function to enable/disable glitch-free preloaded duty cycle updates
+extern void set_pwm_preload(PWM_handle *object, FunctionalState state);
+// Function to set duty cycles of several PWM objects, all taking effect at the same update event
+extern void set_pwm_dutycycles(PWM_handle *objects[], const uint16_t duties[], uint8_t count);
+// Function to restart several timers in the same clock cycle, each with a phase offset (master = iTimers[0])
+extern int start_pwm_group(const uint8_t iTimers[], const uint16_t phases[], uint8_t count);
+// Function to enable complementary output (CHxN) of a TIM1 channel, with idle states when main output is off
+extern int enable_pwm_complementary(PWM_handle *object, uint16_t u16PinN, uint16_t idle_state, uint16_t idle_state_n);
+// Function to set dead time between complementary outputs and off-state behaviour of TIM1
+extern int set_pwm_deadtime(uint8_t iTimer, uint32_t deadtime_ns, uint16_t ossr, uint16_t ossi);
+// Function to enable hardware break input (fault shutdown) of TIM1
+extern int enable_pwm_break(uint8_t iTimer, uint16_t u16PinBKIN, uint16_t polarity, uint16_t auto_output, pwm_break_callback callback);
+// Function to re-enable outputs after a break event and re-arm break notification
+extern void clear_pwm_break(uint8_t iTimer);
+// Function to disable the break input of TIM1 and release its pin
+extern void disable_pwm_break(uint8_t iTimer);
+// Function to measure frequency, duty cycle and jitter of an external PWM signal in PWM input mode
+extern int init_pwm_capture(PWM_capture *capture, uint8_t iTimer, uint8_t iChannel, uint16_t u16Pin, uint32_t f_min, uint8_t filter);
+// Function to get the latest reading of a PWM input without blocking
+extern uint8_t read_pwm_capture(PWM_capture *capture, PWM_capture_value *value);
+// Function to stop a measurement and release timer and pin
+extern void release_pwm_capture(PWM_capture *capture);
+// Function to extend duty cycle resolution by dithering the compare value over 2^frac_bits periods
+extern int enable_pwm_dither(PWM_handle *object, uint8_t frac_bits, uint16_t *table);
+// Function to return to plain duty cycle resolution
+extern void disable_pwm_dither(PWM_handle *object);
+// Function to reach a fractional carrier frequency by alternating the timer period between two lengths
+extern int enable_pwm_freq_dither(uint8_t iTimer, uint32_t f_millihz, uint16_t *table, uint16_t length);
+// Function to return to a constant timer period
+extern void disable_pwm_freq_dither(uint8_t iTimer);
+// Function to check if the period of a timer is dithered
+extern uint8_t is_pwm_freq_dither_active(uint8_t iTimer);
+// Function to emit an exact number of PWM periods on all channels of TIM1, then stop the timer
+extern int start_pwm_pulses(uint8_t iTimer, uint32_t pulses, pwm_burst_callback callback);
+// Function to emit back-to-back bursts of 1 - 256 periods each, lengths fed to the repetition counter by DMA
+extern int start_pwm_burst(uint8_t iTimer, const uint16_t *lengths, uint16_t count, pwm_burst_callback callback);
+// Function to abort a burst or resume continuous operation after it
+extern void stop_pwm_burst(uint8_t iTimer);
+// Function to check if a preloaded duty cycle is not yet live
+extern uint8_t is_pwm_update_pending(PWM_handle *object);
+// Function to register a callback on timer update events (NULL to disable)
+extern void set_pwm_update_callback(uint8_t iTimer, pwm_update_callback callback);
+// Interrupt handler, call from TIMx_IRQHandler (TIM1_UP_IRQHandler, TIM1_CC_IRQHandler and TIM1_BRK_IRQHandler for TIM1)
+extern void pwm_irq_handler(uint8_t iTimer);
 
 #ifdef __cplusplus
 }
 #endif
 
+#include "ch32v_pwm_pins.h"
+
 #endif
\ No newline at end of file
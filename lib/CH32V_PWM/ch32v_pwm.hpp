@@ -0,0 +1,222 @@
+/**
+ *  CH32VX PWM Library
+ *
+ *  Copyright (c) 2024 Florian Korotschenko aka KingKoro
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ *
+ *
+ *  file         : ch32v_pwm.hpp
+ *  description  : header-only C++ wrapper with compile-time timing (C++14)
+ *
+ */
+
+#ifndef __CH32V_PWM_HPP
+#define __CH32V_PWM_HPP
+
+#include <stddef.h>
+#include "ch32v_pwm.h"
+
+/* ++++++++++++++++++++ USER CONFIG AREA BEGIN ++++++++++++++++++++ */
+
+//#define PWM_F_CLK               96000000            /* Timer clock the compile-time solver assumes, has to match SystemCoreClock */
+
+/* ++++++++++++++++++++ USER CONFIG AREA END ++++++++++++++++++++ */
+
+#ifndef PWM_F_CLK
+    #if defined(CH32V10X)
+        #define PWM_F_CLK 72000000
+    #elif defined(CH32V30X)
+        #define PWM_F_CLK 144000000
+    #elif defined(CH32X035) || defined(CH32X033)
+        #define PWM_F_CLK 48000000
+    #else
+        #define PWM_F_CLK 96000000
+    #endif
+#endif
+
+namespace ch32v_pwm
+{
+
+// Timer time base, valid = false if the frequency is not reachable
+struct timebase
+{
+    uint16_t prescaler;
+    uint16_t arr;
+    bool valid;
+};
+
+/*********************************************************************
+ * @fn      solve
+ *
+ * @brief   Compile-time version of solve_pwm_timebase(), same search and step limit,
+ *          so init() arrives at the same registers at runtime.
+ *
+ * @param   f_clk       Timer input clock in Hz
+ * @param   f           Requested frequency in Hz
+ * @param   min_count   Minimum ARR value
+ *
+ * @return  Prescaler/period pair
+ */
+constexpr timebase solve(uint32_t f_clk, uint32_t f, uint16_t min_count)
+{
+    uint32_t a_min = (uint32_t)min_count + 1;
+    if (f == 0 || f_clk / f < a_min) return timebase{0, 0, false};
+    uint32_t n_target = f_clk / f;
+    uint32_t p_lo = n_target >> 16;
+    if (p_lo == 0) p_lo = 1;
+    uint32_t p_hi = n_target / a_min + 1;
+    if (p_hi > 65536) p_hi = 65536;
+    if (p_hi - p_lo > PWM_SOLVER_MAX_STEPS) p_hi = p_lo + PWM_SOLVER_MAX_STEPS;
+    uint32_t a = n_target / p_lo + 1;
+    if (a > 65536) a = 65536;
+    if (a < a_min) a = a_min;
+    uint64_t fp = (uint64_t)f * p_lo;
+    uint64_t prod = fp * a;
+    uint64_t best_err = 0, best_n = 1;
+    uint32_t best_p = 0, best_a = 0;
+    for (uint32_t p = p_lo; p <= p_hi; p++)
+    {
+        while (a > a_min && prod > f_clk)
+        {
+            a--;
+            prod -= fp;
+        }
+        for (uint32_t k = 0; k < 2; k++)
+        {
+            uint32_t ak = a + k;
+            uint64_t pk = prod + (k ? fp : 0);
+            if (ak > 65536) break;
+            uint64_t err = (pk > f_clk) ? (pk - f_clk) : (f_clk - pk);
+            uint64_t n = (uint64_t)p * ak;
+            if (best_p == 0 || err * best_n < best_err * n)
+            {
+                best_err = err;
+                best_n = n;
+                best_p = p;
+                best_a = ak;
+            }
+        }
+        if (best_err == 0) break;
+        fp += f;
+        prod += (uint64_t)f * a;
+    }
+    if (best_p == 0) return timebase{0, 0, false};
+    return timebase{(uint16_t)(best_p - 1), (uint16_t)(best_a - 1), true};
+}
+
+// Register block address of a timer (0 if not available on this MCU)
+constexpr uintptr_t timer_base(uint8_t iTimer)
+{
+    return (iTimer == PWM_TIM1) ? TIM1_BASE :
+           (iTimer == PWM_TIM2) ? TIM2_BASE :
+           (iTimer == PWM_TIM3) ? TIM3_BASE :
+    #if !defined(CH32X035) && !defined(CH32X033)
+           (iTimer == PWM_TIM4) ? TIM4_BASE :
+    #endif
+           0;
+}
+
+#ifndef PWM_PIN_TABLE_NONE
+constexpr PWM_pin_entry pins[] = { PWM_PIN_TABLE };
+#else
+constexpr PWM_pin_entry pins[] = { { 0, 0, 0, 0 } };       // No pin table for this MCU, see ch32v_pwm_pins.h
+#endif
+
+// Index of a timer/channel/pin combination in PWM_PIN_TABLE (-1 if the pin has no such function)
+constexpr int find_pin(uint8_t iTimer, uint8_t iChannel, uint16_t u16Pin)
+{
+    for (size_t i = 0; i < sizeof(pins) / sizeof(pins[0]); i++)
+    {
+        if (pins[i].timer == iTimer && pins[i].channel == iChannel && pins[i].pin == u16Pin) return (int)i;
+    }
+    return -1;
+}
+
+/*********************************************************************
+ * @class   Pwm
+ *
+ * @brief   PWM channel with timing and register addresses resolved by the compiler.
+ *          Invalid timer/channel/pin combinations and unreachable frequencies fail with static_assert.
+ *          Registers the channel with the C library in init(), so it coexists with PWM_handle users
+ *          (timer/pin registry, frequency arbitration) and handle() can be passed to the C API.
+ *          set() is a single store to the compare register and does not track the value in handle().
+ *
+ * @param   Timer       Timer (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ * @param   Channel     Channel of timer (PWM_CH1, PWM_CH2, PWM_CH3 or PWM_CH4)
+ * @param   Pin         Pin code (e.g. 0x0A08 for PA8), AFIO remap is taken from ch32v_pwm_pins.h
+ * @param   Freq        Base carrier frequency in Hz
+ * @param   Resolution  Base for scaling duty cycle (max = Resolution + 1, min = 0)
+ * @param   Mode        PWM_MODE1 or PWM_MODE2
+ * @param   FClk        Timer clock in Hz, has to match SystemCoreClock (default PWM_F_CLK)
+ */
+template <uint8_t Timer, uint8_t Channel, uint16_t Pin, uint32_t Freq, uint16_t Resolution = 254,
+          uint16_t Mode = PWM_MODE2, uint32_t FClk = PWM_F_CLK>
+class Pwm
+{
+#ifdef PWM_PIN_TABLE_NONE
+    static_assert(Timer == 0, "No pin table for CH32X035/X033 yet, use init_pwm() with timer, channel and pin code");
+#endif
+    static_assert(timer_base(Timer) != 0, "Timer not available on this MCU");
+    static_assert(Channel >= PWM_CH1 && Channel <= PWM_CH4, "Invalid channel");
+    static_assert(find_pin(Timer, Channel, Pin) >= 0, "Pin is not an output of this timer channel");
+    static_assert(solve(FClk, Freq, Resolution).valid, "Frequency not reachable with requested resolution");
+
+public:
+    static constexpr uint16_t prescaler = solve(FClk, Freq, Resolution).prescaler;
+    static constexpr uint16_t arr = solve(FClk, Freq, Resolution).arr;
+    static constexpr uint32_t duty_scale = (uint32_t)((((uint64_t)arr + 1) << 16) / ((uint32_t)Resolution + 1));
+    static constexpr uintptr_t ccr_addr = timer_base(Timer) + offsetof(TIM_TypeDef, CH1CVR) + (Channel - 1) * 4;
+    static constexpr uintptr_t ccer_addr = timer_base(Timer) + offsetof(TIM_TypeDef, CCER);
+    static constexpr uint16_t ccer_mask = TIM_CC1E << ((Channel - 1) * 4);
+    static constexpr uint32_t remap = (find_pin(Timer, Channel, Pin) >= 0) ? pins[find_pin(Timer, Channel, Pin)].remap : 0;
+
+    // Compare register value for a duty cycle (same scaling as set_pwm_dutycycle())
+    static constexpr uint16_t compare(uint16_t duty)
+    {
+        return (duty > Resolution) ? 0 : (uint16_t)(arr + 1 - (((uint32_t)duty * duty_scale + 0x8000) >> 16));
+    }
+
+    // Configure timer and channel, PWM_ERR_CONFLICT if the timer runs with a different time base than solved at compile time
+    int init()
+    {
+        init_pwm_pin_args args = { &handle_, Timer, Channel, Pin, remap, Freq, Resolution, Mode };
+        int ret = var_init_pwm_pin(args);
+        if (ret != PWM_OK) return ret;
+        if (handle_.prescaler != prescaler || handle_.arr != arr)
+        {
+            release_pwm(&handle_);
+            return PWM_ERR_CONFLICT;
+        }
+        return PWM_OK;
+    }
+
+    void set(uint16_t duty) { *reinterpret_cast<volatile uint16_t *>(ccr_addr) = compare(duty); }
+    void enable() { *reinterpret_cast<volatile uint16_t *>(ccer_addr) |= ccer_mask; }
+    void disable() { *reinterpret_cast<volatile uint16_t *>(ccer_addr) &= (uint16_t)~ccer_mask; }
+    void release() { release_pwm(&handle_); }
+    PWM_handle *handle() { return &handle_; }
+
+private:
+    PWM_handle handle_ = {};
+};
+
+}
+
+#endif
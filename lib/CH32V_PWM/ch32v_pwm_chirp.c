@@ -0,0 +1,376 @@
+/**
+ *  CH32VX PWM Library
+ *
+ *  Copyright (c) 2024 Florian Korotschenko aka KingKoro
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ *
+ *
+ *  file         : ch32v_pwm_chirp.c
+ *  description  : ch32v pwm library frequency sweep (chirp) generator
+ *
+ */
+
+#include "ch32v_pwm_chirp.h"
+
+// Sweep streaming on a timer (index = PWM_TIMx), looked up by the DMA callbacks
+static PWM_chirp *pwm_chirp_active[PWM_TIM4 + 1];
+
+/*********************************************************************
+ * @fn      calc_pwm_log2
+ *
+ * @brief   Calculate the binary logarithm of an integer without FPU, the fraction bit by bit
+ *          from repeated squaring of the normalized mantissa
+ * 
+ * @param   x           Argument (at least 1)
+ *
+ * @return  log2(x) in Q24
+ */
+static int32_t calc_pwm_log2(uint32_t x)
+{
+    uint8_t msb = 31;
+    while (msb > 0 && !(x >> msb)) msb--;
+    int32_t r = (int32_t)msb << 24;
+    uint64_t y = ((uint64_t)x << 31) >> msb;                    // Mantissa in Q31, 1 <= y < 2
+    for (int32_t bit = 1 << 23; bit; bit >>= 1)
+    {
+        y = (y * y) >> 31;
+        if (y >= (2ULL << 31))
+        {
+            y >>= 1;
+            r |= bit;
+        }
+    }
+    return r;
+}
+
+/*********************************************************************
+ * @fn      step_pwm_chirp
+ *
+ * @brief   Get the frequency of the next period of a sweep and advance it. Over a period of 1 / f,
+ *          a logarithmic sweep changes f by a constant amount, a linear sweep by a constant / f.
+ *          Once the stop frequency is passed, one final period at exactly the stop frequency follows.
+ * 
+ * @param   chirp       Pointer to PWM_chirp struct
+ *
+ * @return  Frequency in mHz
+ */
+static uint32_t step_pwm_chirp(PWM_chirp *chirp)
+{
+    if (chirp->state != 0)
+    {
+        chirp->state = 2;
+        return chirp->f_stop;
+    }
+    uint32_t f = (uint32_t)(chirp->f_q >> 16);
+    int64_t d = (chirp->profile == PWM_CHIRP_LOG) ? chirp->step : chirp->step / (int64_t)f;
+    int64_t next = (int64_t)chirp->f_q + d;
+    int64_t stop = (int64_t)chirp->f_stop << 16;
+    if ((chirp->f_stop > chirp->f_start) ? (next >= stop) : (next <= stop)) chirp->state = 1;
+    chirp->f_q = (uint64_t)next;
+    chirp->periods++;
+    return f;
+}
+
+/*********************************************************************
+ * @fn      put_pwm_chirp_frame
+ *
+ * @brief   Write the burst frame of a period {ATRLR, RPTCR, CH1CVR ... last channel}, 50% duty cycle
+ *          on the group's channels, channels below the group keep their compare value
+ * 
+ * @param   chirp       Pointer to PWM_chirp struct
+ * @param   frame       Destination for chirp->words half-words
+ * @param   f           Frequency in mHz
+ *
+ * @return  None
+ */
+static void put_pwm_chirp_frame(PWM_chirp *chirp, uint16_t *frame, uint32_t f)
+{
+    PWM_group *group = chirp->group;
+    uint8_t center = (group->tim->CTLR1 & TIM_CMS) != 0;        // Center-aligned: ATRLR = counts
+    uint64_t num = (uint64_t)get_pwm_clock(group->timer) * 1000;
+    uint64_t div = (uint64_t)chirp->divider * f;
+    uint32_t n = (uint32_t)((num + (div >> 1)) / div);
+    if (n < 2) n = 2;
+    if (n > 65536U - center) n = 65536U - center;
+    put_pwm_group_frame(group, frame, n, 1);
+}
+
+/*********************************************************************
+ * @fn      fill_pwm_chirp
+ *
+ * @brief   Generate the next frames of a sweep, one per update event
+ * 
+ * @param   chirp       Pointer to PWM_chirp struct
+ * @param   buffer      Destination for frames * chirp->words half-words
+ * @param   frames      Number of frames
+ *
+ * @return  Number of frames up to the end of the sweep if it ends in this part, else frames
+ */
+static uint16_t fill_pwm_chirp(PWM_chirp *chirp, uint16_t *buffer, uint16_t frames)
+{
+    uint16_t used = frames;
+    for (uint16_t i = 0; i < frames; i++)
+    {
+        if (chirp->copies == 0)
+        {
+            chirp->f_cur = step_pwm_chirp(chirp);
+            chirp->copies = get_pwm_updates(chirp->group->timer);
+        }
+        put_pwm_chirp_frame(chirp, &buffer[i * chirp->words], chirp->f_cur);
+        chirp->copies--;
+        if (chirp->state == 2 && chirp->copies == 0 && chirp->end == NULL)
+        {
+            chirp->end = buffer;
+            used = i + 1;
+        }
+    }
+    chirp->f_millihz = chirp->f_cur;
+    return used;
+}
+
+/*********************************************************************
+ * @fn      finish_pwm_chirp
+ *
+ * @brief   End the stream of a sweep after its final period was handed to the timer,
+ *          the timer keeps running at the stop frequency
+ * 
+ * @param   chirp       Pointer to PWM_chirp struct
+ *
+ * @return  None
+ */
+static void finish_pwm_chirp(PWM_chirp *chirp)
+{
+    uint8_t iTimer = chirp->group->timer;
+    stop_pwm_stream(iTimer);
+    pwm_chirp_active[iTimer] = NULL;
+    chirp->running = 0;
+    chirp->f_millihz = chirp->f_stop;
+    if (chirp->complete) chirp->complete(iTimer, chirp->f_stop);
+}
+
+/*********************************************************************
+ * @fn      refill_pwm_chirp
+ *
+ * @brief   DMA callback of a streamed sweep, refills the half of the buffer that just finished playing
+ *          or ends the sweep if that half held its final period
+ * 
+ * @param   iTimer      Timer of the stream
+ * @param   buffer      Part of the buffer to refill
+ * @param   count       Number of half-words to refill
+ *
+ * @return  None
+ */
+static void refill_pwm_chirp(uint8_t iTimer, uint16_t *buffer, uint16_t count)
+{
+    PWM_chirp *chirp = pwm_chirp_active[iTimer];
+    if (chirp == NULL) return;
+    if (chirp->end == buffer)
+    {
+        finish_pwm_chirp(chirp);
+        return;
+    }
+    fill_pwm_chirp(chirp, buffer, count / chirp->words);
+    if (chirp->progress) chirp->progress(iTimer, chirp->f_millihz);
+}
+
+/*********************************************************************
+ * @fn      end_pwm_chirp
+ *
+ * @brief   DMA callback of a precomputed sweep, called after the last frame was transferred
+ * 
+ * @param   iTimer      Timer of the stream
+ * @param   buffer      Streamed buffer
+ * @param   count       Number of half-words streamed
+ *
+ * @return  None
+ */
+static void end_pwm_chirp(uint8_t iTimer, uint16_t *buffer, uint16_t count)
+{
+    (void)buffer; (void)count;
+    PWM_chirp *chirp = pwm_chirp_active[iTimer];
+    if (chirp) finish_pwm_chirp(chirp);
+}
+
+/*********************************************************************
+ * @fn      init_pwm_chirp
+ *
+ * @brief   Initialize a frequency sweep generator on a group of channels, e.g. for resonance
+ *          measurements of actuators. The group should contain all used channels of the timer,
+ *          they output 50% duty cycle while sweeping.
+ * 
+ * @param   chirp       Pointer to PWM_chirp struct to initialize
+ * @param   group       Pointer to initialized PWM_group struct, has to stay valid
+ * @param   buffer      Buffer for frames * (2 + last channel of group) half-words, has to stay valid
+ * @param   frames      Number of frames (update events) in buffer (even, at least 2), half of it is refilled at once
+ *
+ * @return  PWM_OK on success, PWM_ERR_TIMER if the timer has no DMA request mapping,
+ *          PWM_ERR_RANGE if buffer or frames are invalid, PWM_ERR_BUSY if the timer is cascaded (see init_pwm_cascade())
+ */
+int init_pwm_chirp(PWM_chirp *chirp, PWM_group *group, uint16_t *buffer, uint16_t frames)
+{
+    if (group == NULL || group->tim == NULL || get_pwm_dma_channel(group->timer) == NULL) return PWM_ERR_TIMER;
+    if (is_pwm_cascaded(group->timer)) return PWM_ERR_BUSY;     // Periods are computed from the internal clock
+    uint8_t words = 2 + group->first + group->count - 1;
+    if (buffer == NULL || frames < 2 || (frames & 1) || (uint32_t)frames * words > 0xFFFF) return PWM_ERR_RANGE;
+    chirp->group = group;
+    chirp->buffer = buffer;
+    chirp->frames = frames;
+    chirp->words = words;
+    chirp->running = 0;
+    chirp->f_millihz = 0;
+    chirp->periods = 0;
+    return PWM_OK;
+}
+
+/*********************************************************************
+ * @fn      start_pwm_chirp
+ *
+ * @brief   Sweep the carrier frequency of a group from f_start to f_stop (up or down) within a duration.
+ *          The prescaler is fixed for the sweep, so all frequencies have to fit into one prescaler
+ *          setting. One burst frame {ATRLR, RPTCR, compare registers} per update event is
+ *          generated and streamed by DMA. If the whole sweep fits into the buffer, it is precomputed
+ *          and played without any CPU load, else the buffer is streamed in ping-pong mode and
+ *          pwm_dma_irq_handler() refills one half at a time (one division per period, progress callback
+ *          after each refill). Afterwards the timer keeps running at f_stop until stop_pwm_chirp().
+ *          The sweep starts with the next period, handles keep their settings.
+ * 
+ * @param   chirp       Pointer to initialized PWM_chirp struct
+ * @param   f_start     Start frequency in mHz
+ * @param   f_stop      Stop frequency in mHz (different from f_start)
+ * @param   duration_ms Duration of the sweep in ms
+ * @param   profile     PWM_CHIRP_LINEAR or PWM_CHIRP_LOG
+ * @param   progress    Function called from pwm_dma_irq_handler() after each refill (NULL = none)
+ * @param   complete    Function called from pwm_dma_irq_handler() when the final period is handed to the timer (NULL = none)
+ *
+ * @return  PWM_OK on success, PWM_ERR_RANGE if an argument is invalid, PWM_ERR_FREQ if the frequencies
+ *          don't fit into one prescaler setting with at least 2 counts per period,
+ *          PWM_ERR_BUSY if a sweep or another stream runs on the timer or it has been cascaded since init_pwm_chirp()
+ */
+int start_pwm_chirp(PWM_chirp *chirp, uint32_t f_start, uint32_t f_stop, uint32_t duration_ms, uint8_t profile, pwm_chirp_callback progress, pwm_chirp_callback complete)
+{
+    PWM_group *group = chirp->group;
+    TIM_TypeDef *tim = group->tim;
+    if (f_start == 0 || f_stop == 0 || f_start == f_stop || duration_ms == 0 || profile > PWM_CHIRP_LOG) return PWM_ERR_RANGE;
+    if (chirp->running || is_pwm_stream_active(group->timer) || is_pwm_cascaded(group->timer)) return PWM_ERR_BUSY;
+
+    // ---------- Prescaler for the lowest frequency, highest one needs at least 2 counts ----------
+    uint8_t center = (tim->CTLR1 & TIM_CMS) != 0;
+    uint64_t num = (uint64_t)get_pwm_clock(group->timer) * 1000;
+    uint32_t f_min = (f_start < f_stop) ? f_start : f_stop;
+    uint32_t f_max = (f_start < f_stop) ? f_stop : f_start;
+    uint64_t per_step = (uint64_t)(65536U - center) * f_min;
+    uint64_t divider = (num + per_step - 1) / per_step;
+    if (divider == 0) divider = 1;
+    if (divider > 65536 || num / (divider * f_max) < 2) return PWM_ERR_FREQ;
+
+    // ---------- Step per period ----------
+    int64_t step;
+    if (profile == PWM_CHIRP_LOG)
+    {
+        // f changes by 1000 * ln(f_stop / f_start) / duration_s mHz per period, in Q16
+        int64_t ln = ((int64_t)(calc_pwm_log2(f_stop) - calc_pwm_log2(f_start)) * 744261118LL) >> 30;   // Q24, ln(2) in Q30
+        step = ln * 1000000 / ((int64_t)duration_ms * 256);
+    }
+    else
+    {
+        // f changes by 1000000 * (f_stop - f_start) / duration_ms / f mHz per period, in Q16
+        uint64_t df = (f_stop > f_start) ? f_stop - f_start : f_start - f_stop;
+        uint64_t q = df * 65536000 / duration_ms;
+        uint64_t r = df * 65536000 % duration_ms;
+        if (q >> 52) return PWM_ERR_RANGE;
+        step = (int64_t)(q * 1000 + r * 1000 / duration_ms);
+        if (f_stop < f_start) step = -step;
+    }
+    if (step == 0) return PWM_ERR_RANGE;                        // Sweep too slow for the step resolution
+
+    // ---------- First period goes directly into the shadow registers ----------
+    chirp->profile = profile;
+    chirp->divider = (uint32_t)divider;
+    chirp->f_start = f_start;
+    chirp->f_stop = f_stop;
+    chirp->f_q = (uint64_t)f_start << 16;
+    chirp->step = step;
+    chirp->state = 0;
+    chirp->periods = 0;
+    chirp->end = NULL;
+    chirp->progress = progress;
+    chirp->complete = complete;
+    uint16_t frame[6];
+    chirp->f_cur = step_pwm_chirp(chirp);
+    chirp->copies = get_pwm_updates(group->timer) - 1;
+    put_pwm_chirp_frame(chirp, frame, chirp->f_cur);
+    tim->CTLR1 |= TIM_UDIS;
+    for (uint8_t k = 0; k < group->count; k++)
+    {
+        set_pwm_preload(group->channels[k], ENABLE);
+        *group->channels[k]->ccr = frame[1 + group->first + k];
+    }
+    tim->PSC = (uint16_t)(divider - 1);
+    tim->ATRLR = frame[0];
+    tim->CTLR1 &= (uint16_t)~TIM_UDIS;
+
+    // ---------- Precompute whole sweep if it fits, else stream in ping-pong mode ----------
+    uint16_t half = chirp->frames / 2;
+    uint16_t used = fill_pwm_chirp(chirp, chirp->buffer, half);
+    if (chirp->end == NULL) used = half + fill_pwm_chirp(chirp, chirp->buffer + half * chirp->words, half);
+    uint8_t oneshot = (chirp->end != NULL);
+    pwm_chirp_active[group->timer] = chirp;
+    chirp->running = 1;
+    TIM_DMAConfig(tim, TIM_DMABase_ARR, (uint16_t)((chirp->words - 1) << 8));
+    int ret = oneshot ? start_pwm_dma(group->timer, &tim->DMAADR, chirp->buffer, (uint16_t)(used * chirp->words), PWM_STREAM_ONESHOT, end_pwm_chirp)
+                      : start_pwm_dma(group->timer, &tim->DMAADR, chirp->buffer, (uint16_t)(chirp->frames * chirp->words), PWM_STREAM_PINGPONG, refill_pwm_chirp);
+    if (ret != PWM_OK)
+    {
+        pwm_chirp_active[group->timer] = NULL;
+        chirp->running = 0;
+    }
+    return ret;
+}
+
+/*********************************************************************
+ * @fn      stop_pwm_chirp
+ *
+ * @brief   Stop a running sweep, or end a completed one, and return the group to the time base
+ *          and duty cycles of its handles at the next update event
+ * 
+ * @param   chirp       Pointer to PWM_chirp struct
+ *
+ * @return  None
+ */
+void stop_pwm_chirp(PWM_chirp *chirp)
+{
+    PWM_group *group = chirp->group;
+    if (group == NULL || group->tim == NULL) return;
+    if (chirp->running)
+    {
+        stop_pwm_stream(group->timer);
+        pwm_chirp_active[group->timer] = NULL;
+        chirp->running = 0;
+    }
+    PWM_handle *ref = group->channels[0];
+    group->tim->CTLR1 |= TIM_UDIS;
+    group->tim->PSC = ref->prescaler;
+    group->tim->ATRLR = ref->arr + ((group->tim->CTLR1 & TIM_CMS) != 0);
+    for (uint8_t k = 0; k < group->count; k++)
+    {
+        *group->channels[k]->ccr = group->channels[k]->duty_cycle;
+    }
+    group->tim->CTLR1 &= (uint16_t)~TIM_UDIS;
+}
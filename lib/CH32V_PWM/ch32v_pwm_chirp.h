@@ -0,0 +1,81 @@
+/**
+ *  CH32VX PWM Library
+ *
+ *  Copyright (c) 2024 Florian Korotschenko aka KingKoro
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ *
+ *
+ *  file         : ch32v_pwm_chirp.h
+ *  description  : ch32v pwm library frequency sweep (chirp) generator header
+ *
+ */
+
+#ifndef __CH32V_PWM_CHIRP_H
+#define __CH32V_PWM_CHIRP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "ch32v_pwm_dma.h"
+
+// Sweep profiles
+#define PWM_CHIRP_LINEAR    0   // Frequency changes by the same amount per second
+#define PWM_CHIRP_LOG       1   // Frequency changes by the same factor per second (same time per octave)
+
+// Callback for sweep progress and completion, receives timer number and current frequency in mHz
+typedef void (*pwm_chirp_callback)(uint8_t iTimer, uint32_t f_millihz);
+
+// State of a frequency sweep generator
+typedef struct
+{
+    PWM_group *group;               // Channels driven with 50% duty cycle (should be all channels of the timer)
+    uint16_t *buffer;               // Buffer of frames * (2 + last channel) half-words
+    uint16_t frames;                // Number of frames (update events) in buffer
+    uint8_t words;                  // Half-words per frame {ATRLR, RPTCR, CH1CVR ... last channel}
+    uint8_t profile;                // PWM_CHIRP_LINEAR or PWM_CHIRP_LOG
+    uint8_t state;                  // 0 = sweeping, 1 = stop frequency reached, 2 = final period generated
+    uint8_t copies;                 // Frames left of the current period (2 per period if updating at top and bottom)
+    uint32_t divider;               // Prescaler divider (PSC + 1) while sweeping
+    uint32_t f_start;               // Start frequency in mHz
+    uint32_t f_stop;                // Stop frequency in mHz
+    uint32_t f_cur;                 // Frequency of the current period in mHz
+    uint64_t f_q;                   // Frequency of the next period in mHz (Q16)
+    int64_t step;                   // Per period: added to f_q (PWM_CHIRP_LOG) or divided by the frequency and added (PWM_CHIRP_LINEAR)
+    uint16_t *end;                  // Half of buffer holding the final period (NULL = not generated yet)
+    pwm_chirp_callback progress;    // Called after every buffer refill (NULL = none)
+    pwm_chirp_callback complete;    // Called when the final period is handed to the timer (NULL = none)
+    volatile uint32_t f_millihz;    // Frequency of the last generated period in mHz
+    volatile uint32_t periods;      // Number of generated periods
+    volatile uint8_t running;       // Sweep is streaming
+} PWM_chirp;
+
+// Function to initialize a frequency sweep generator on a group of channels
+extern int init_pwm_chirp(PWM_chirp *chirp, PWM_group *group, uint16_t *buffer, uint16_t frames);
+// Function to sweep the carrier frequency from f_start to f_stop (mHz) within duration_ms by DMA
+extern int start_pwm_chirp(PWM_chirp *chirp, uint32_t f_start, uint32_t f_stop, uint32_t duration_ms, uint8_t profile, pwm_chirp_callback progress, pwm_chirp_callback complete);
+// Function to stop a sweep and return the group to its time base and duty cycles
+extern void stop_pwm_chirp(PWM_chirp *chirp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,512 @@
+/**
+ *  CH32VX PWM Library
+ *
+ *  Copyright (c) 2024 Florian Korotschenko aka KingKoro
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ *
+ *
+ *  file         : ch32v_pwm_dma.c
+ *  description  : ch32v pwm library DMA streaming
+ *
+ */
+
+#include "ch32v_pwm_dma.h"
+
+// State of the update DMA request of a timer
+typedef struct
+{
+    uint16_t *buffer;                       // Streamed buffer
+    uint16_t length;                        // Number of transfers in buffer
+    uint8_t mode;                           // PWM_STREAM_ONESHOT, PWM_STREAM_CIRCULAR or PWM_STREAM_PINGPONG
+    pwm_stream_callback callback;           // Called from pwm_dma_irq_handler() (NULL = none)
+} PWM_stream_state;
+
+static PWM_stream_state pwm_stream_state[PWM_TIM4 + 1];
+
+#if !defined(CH32X035) && !defined(CH32X033)
+// DMA1 channel serving TIMx_UP request (index = PWM_TIMx)
+static DMA_Channel_TypeDef * const pwm_dma_channels[PWM_TIM4 + 1] = {NULL, DMA1_Channel5, DMA1_Channel2, DMA1_Channel3, DMA1_Channel7};
+static const uint8_t pwm_dma_numbers[PWM_TIM4 + 1] = {0, 5, 2, 3, 7};
+#endif
+
+/*********************************************************************
+ * @fn      get_pwm_dma_channel
+ *
+ * @brief   Resolve the DMA channel serving the update request of a timer
+ *          (TIM1: DMA1_Channel5, TIM2: DMA1_Channel2, TIM3: DMA1_Channel3, TIM4: DMA1_Channel7).
+ *          The request mapping of CH32X035 is not supported yet.
+ * 
+ * @param   iTimer      Timer (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ *
+ * @return  Pointer to DMA channel registers, NULL if not available
+ */
+DMA_Channel_TypeDef *get_pwm_dma_channel(uint8_t iTimer)
+{
+    #if !defined(CH32X035) && !defined(CH32X033)
+    if (get_pwm_timer(iTimer) != NULL) return pwm_dma_channels[iTimer];
+    #endif
+    return NULL;
+}
+
+/*********************************************************************
+ * @fn      get_pwm_dma_number
+ *
+ * @brief   Resolve the DMA1 channel number (1 - 7) serving the update request of a timer
+ * 
+ * @param   iTimer      Timer (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ *
+ * @return  Channel number, 0 if not available
+ */
+static uint8_t get_pwm_dma_number(uint8_t iTimer)
+{
+    #if !defined(CH32X035) && !defined(CH32X033)
+    if (get_pwm_timer(iTimer) != NULL) return pwm_dma_numbers[iTimer];
+    #endif
+    return 0;
+}
+
+/*********************************************************************
+ * @fn      is_pwm_stream_active
+ *
+ * @brief   Check if the update DMA channel of a timer is transferring (by this library or other code)
+ * 
+ * @param   iTimer      Timer (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ *
+ * @return  1 if active, 0 if idle or finished
+ */
+uint8_t is_pwm_stream_active(uint8_t iTimer)
+{
+    DMA_Channel_TypeDef *ch = get_pwm_dma_channel(iTimer);
+    if (ch == NULL || !(ch->CFGR & DMA_CFGR1_EN)) return 0;
+    return (ch->CFGR & DMA_CFGR1_CIRC) || ch->CNTR != 0;
+}
+
+/*********************************************************************
+ * @fn      start_pwm_dma
+ *
+ * @brief   Let the update request of a timer copy a buffer of half-words into a timer register,
+ *          one per update event (e.g. compare register, ATRLR or DMAADR for bursts).
+ *          Building block of the streaming functions, modes and callback as in start_pwm_stream().
+ * 
+ * @param   iTimer      Timer (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ * @param   dst         Destination register of the timer
+ * @param   buffer      Source buffer, has to stay valid while streaming
+ * @param   length      Number of transfers (at least 2 for PWM_STREAM_PINGPONG)
+ * @param   mode        PWM_STREAM_ONESHOT, PWM_STREAM_CIRCULAR or PWM_STREAM_PINGPONG
+ * @param   callback    Function called at half/full transfer (NULL = no interrupt)
+ *
+ * @return  PWM_OK on success, PWM_ERR_TIMER if the timer has no DMA request mapping,
+ *          PWM_ERR_RANGE if buffer, length or mode is invalid, PWM_ERR_BUSY if the DMA channel is in use
+ */
+int start_pwm_dma(uint8_t iTimer, __IO uint16_t *dst, uint16_t *buffer, uint16_t length, uint8_t mode, pwm_stream_callback callback)
+{
+    TIM_TypeDef *tim = get_pwm_timer(iTimer);
+    DMA_Channel_TypeDef *ch = get_pwm_dma_channel(iTimer);
+    uint8_t n = get_pwm_dma_number(iTimer);
+    PWM_stream_state *state = &pwm_stream_state[iTimer];
+    DMA_InitTypeDef DMA_InitStructure = {0};
+    if (ch == NULL) return PWM_ERR_TIMER;
+    if (buffer == NULL || length == 0 || mode > PWM_STREAM_PINGPONG || (mode == PWM_STREAM_PINGPONG && length < 2)) return PWM_ERR_RANGE;
+    if (is_pwm_stream_active(iTimer)) return PWM_ERR_BUSY;
+
+    // ---------- Configure DMA channel ----------
+    TIM_DMACmd(tim, TIM_DMA_Update, DISABLE);
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+    DMA_DeInit(ch);
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)dst;
+    DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)buffer;
+    DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralDST;
+    DMA_InitStructure.DMA_BufferSize = length;
+    DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+    DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+    DMA_InitStructure.DMA_Mode = (mode == PWM_STREAM_ONESHOT) ? DMA_Mode_Normal : DMA_Mode_Circular;
+    DMA_InitStructure.DMA_Priority = DMA_Priority_VeryHigh;
+    DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+    DMA_Init(ch, &DMA_InitStructure);
+    state->buffer = buffer;
+    state->length = length;
+    state->mode = mode;
+    state->callback = callback;
+
+    // ---------- Half/full transfer notification ----------
+    DMA1->INTFCR = (DMA1_FLAG_GL1 | DMA1_FLAG_TC1 | DMA1_FLAG_HT1 | DMA1_FLAG_TE1) << ((n - 1) * 4);
+    if (callback)
+    {
+        DMA_ITConfig(ch, (mode == PWM_STREAM_PINGPONG) ? (DMA_IT_TC | DMA_IT_HT) : DMA_IT_TC, ENABLE);
+        NVIC_EnableIRQ((IRQn_Type)(DMA1_Channel1_IRQn + n - 1));    // DMA1 channel interrupts are numbered consecutively
+    }
+
+    // ---------- Start, first transfer happens at next update event ----------
+    DMA_Cmd(ch, ENABLE);
+    TIM_DMACmd(tim, TIM_DMA_Update, ENABLE);
+    return PWM_OK;
+}
+
+/*********************************************************************
+ * @fn      convert_pwm_dutycycles
+ *
+ * @brief   Convert duty cycles into compare register values of PWM object for streaming.
+ *          Can be done in place (buffer == duties).
+ * 
+ * @param   object      Pointer to PWM_handle struct the buffer is streamed to
+ * @param   buffer      Destination buffer for compare register values
+ * @param   duties      Duty cycles (0 = off, period + 1 = always on)
+ * @param   count       Number of values
+ *
+ * @return  None
+ */
+void convert_pwm_dutycycles(PWM_handle *object, uint16_t *buffer, const uint16_t duties[], uint16_t count)
+{
+    for (uint16_t i = 0; i < count; i++) buffer[i] = calc_pwm_compare(object, duties[i]);
+}
+
+/*********************************************************************
+ * @fn      start_pwm_stream
+ *
+ * @brief   Stream compare register values (see convert_pwm_dutycycles()) from a buffer into the channel
+ *          of a PWM object, one value per timer period, without CPU load. The timer's update DMA request
+ *          is used, so one stream per timer is possible. Compare register preload is enabled for
+ *          glitch-free changes, each value becomes active one period after it was transferred.
+ *          In PWM_STREAM_PINGPONG mode the callback receives the half of the buffer that just finished
+ *          playing and can refill it while the other half plays. The callback is called from
+ *          pwm_dma_irq_handler(), which has to be forwarded from the DMA channel's interrupt handler.
+ * 
+ * @param   object      Pointer to PWM_handle struct to stream into
+ * @param   buffer      Buffer of compare register values, has to stay valid while streaming
+ * @param   length      Number of values in buffer (at least 2 for PWM_STREAM_PINGPONG)
+ * @param   mode        PWM_STREAM_ONESHOT, PWM_STREAM_CIRCULAR or PWM_STREAM_PINGPONG
+ * @param   callback    Function called when (half of) the buffer was played (NULL = none)
+ *
+ * @return  PWM_OK on success, PWM_ERR_TIMER if the timer has no DMA request mapping,
+ *          PWM_ERR_RANGE if buffer, length or mode is invalid, PWM_ERR_BUSY if the DMA channel is in use
+ */
+int start_pwm_stream(PWM_handle *object, uint16_t *buffer, uint16_t length, uint8_t mode, pwm_stream_callback callback)
+{
+    if (object->tim == NULL || get_pwm_dma_channel(object->timer) == NULL) return PWM_ERR_TIMER;
+    if (buffer == NULL || length == 0 || mode > PWM_STREAM_PINGPONG || (mode == PWM_STREAM_PINGPONG && length < 2)) return PWM_ERR_RANGE;
+    if (is_pwm_stream_active(object->timer)) return PWM_ERR_BUSY;
+    set_pwm_preload(object, ENABLE);
+    return start_pwm_dma(object->timer, object->ccr, buffer, length, mode, callback);
+}
+
+/*********************************************************************
+ * @fn      init_pwm_group
+ *
+ * @brief   Combine initialized PWM objects into a group for DMA burst updates. The objects have to
+ *          use neighbouring channels of the same timer and are passed in channel order
+ *          (e.g. CH1, CH2, CH3, CH4 or CH2, CH3).
+ * 
+ * @param   group       Pointer to PWM_group struct to initialize
+ * @param   objects     Array of pointers to initialized PWM_handle structs
+ * @param   count       Number of objects (1 - 4)
+ *
+ * @return  PWM_OK on success, PWM_ERR_RANGE if count is invalid or channels are not neighbours on one timer
+ */
+int init_pwm_group(PWM_group *group, PWM_handle *objects[], uint8_t count)
+{
+    if (count == 0 || count > 4 || objects[0]->tim == NULL) return PWM_ERR_RANGE;
+    for (uint8_t i = 1; i < count; i++)
+    {
+        if (objects[i]->timer != objects[0]->timer || objects[i]->channel != objects[0]->channel + i) return PWM_ERR_RANGE;
+    }
+    group->timer = objects[0]->timer;
+    group->first = objects[0]->channel;
+    group->count = count;
+    group->tim = objects[0]->tim;
+    for (uint8_t i = 0; i < 4; i++) group->channels[i] = (i < count) ? objects[i] : NULL;
+    return PWM_OK;
+}
+
+/*********************************************************************
+ * @fn      convert_pwm_group_frames
+ *
+ * @brief   Convert interleaved duty cycle frames ({CHa, CHa+1, ...} per period) into compare
+ *          register values of the group's channels. Can be done in place (buffer == duties).
+ * 
+ * @param   group       Pointer to initialized PWM_group struct
+ * @param   buffer      Destination buffer for frames * group->count compare register values
+ * @param   duties      Interleaved duty cycles (0 = off, period + 1 = always on)
+ * @param   frames      Number of frames
+ *
+ * @return  None
+ */
+void convert_pwm_group_frames(PWM_group *group, uint16_t *buffer, const uint16_t duties[], uint16_t frames)
+{
+    uint32_t n = (uint32_t)frames * group->count;
+    for (uint32_t i = 0; i < n; i++) buffer[i] = calc_pwm_compare(group->channels[i % group->count], duties[i]);
+}
+
+/*********************************************************************
+ * @fn      start_pwm_group_stream
+ *
+ * @brief   Stream interleaved frames of compare register values into all channels of a group, one frame
+ *          per timer period. The timer's DMA burst interface (DMACFGR/DMAADR) writes a whole frame
+ *          into the neighbouring compare registers at each update request, so a single DMA channel
+ *          serves up to four channels and all of them change at the same update event.
+ *          Modes and callback work like start_pwm_stream(), callback counts are in values (frames * count).
+ * 
+ * @param   group       Pointer to initialized PWM_group struct
+ * @param   buffer      Buffer of frames * group->count compare register values, has to stay valid while streaming
+ * @param   frames      Number of frames in buffer (even and at least 2 for PWM_STREAM_PINGPONG)
+ * @param   mode        PWM_STREAM_ONESHOT, PWM_STREAM_CIRCULAR or PWM_STREAM_PINGPONG
+ * @param   callback    Function called when (half of) the buffer was played (NULL = none)
+ *
+ * @return  PWM_OK on success, PWM_ERR_TIMER if the timer has no DMA request mapping,
+ *          PWM_ERR_RANGE if buffer, frames or mode is invalid, PWM_ERR_BUSY if the DMA channel is in use
+ */
+int start_pwm_group_stream(PWM_group *group, uint16_t *buffer, uint16_t frames, uint8_t mode, pwm_stream_callback callback)
+{
+    uint32_t length = (uint32_t)frames * group->count;
+    if (group->tim == NULL || get_pwm_dma_channel(group->timer) == NULL) return PWM_ERR_TIMER;
+    if (buffer == NULL || frames == 0 || length > 0xFFFF || mode > PWM_STREAM_PINGPONG) return PWM_ERR_RANGE;
+    if (mode == PWM_STREAM_PINGPONG && (frames & 1)) return PWM_ERR_RANGE;         // Halves have to end on a frame boundary
+    if (is_pwm_stream_active(group->timer)) return PWM_ERR_BUSY;
+    for (uint8_t i = 0; i < group->count; i++) set_pwm_preload(group->channels[i], ENABLE);
+    // Burst of count transfers starting at compare register of first channel (CH1CVR ... CH4CVR are neighbours)
+    TIM_DMAConfig(group->tim, TIM_DMABase_CCR1 + (group->first - 1), (uint16_t)((group->count - 1) << 8));
+    return start_pwm_dma(group->timer, &group->tim->DMAADR, buffer, (uint16_t)length, mode, callback);
+}
+
+/*********************************************************************
+ * @fn      put_pwm_group_frame
+ *
+ * @brief   Write the burst frame of one period {ATRLR, RPTCR, CH1CVR ... last channel of group}
+ *          for streaming into a timer from ATRLR on (TIM_DMABase_ARR). The compare values of the
+ *          group's channels are rescaled to the period, channels below the group keep their value.
+ * 
+ * @param   group       Pointer to initialized PWM_group struct
+ * @param   frame       Destination for 2 + last channel half-words
+ * @param   n           Counts of the period (2 - 65536, 65535 for center-aligned timers)
+ * @param   half        1 for 50% duty cycle on the group's channels, 0 to keep their duty ratios
+ *
+ * @return  None
+ */
+void put_pwm_group_frame(PWM_group *group, uint16_t *frame, uint32_t n, uint8_t half)
+{
+    uint8_t center = (group->tim->CTLR1 & TIM_CMS) != 0;                    // Center-aligned: ATRLR = arr + 1
+    uint8_t last = group->first + group->count - 1;
+    __IO uint16_t *ccr = &group->tim->CH1CVR;
+    frame[0] = (uint16_t)(n - 1 + center);
+    frame[1] = group->tim->RPTCR;
+    for (uint8_t ch = 1; ch <= last; ch++)
+    {
+        uint16_t v = ccr[(ch - 1) * 2];                                     // Compare registers are 32 bit apart
+        if (ch >= group->first)
+        {
+            PWM_handle *h = group->channels[ch - group->first];
+            uint32_t len = (uint32_t)h->arr + 1;
+            uint32_t on = half ? n / 2 : (uint32_t)(((uint64_t)(len - h->duty_cycle) * n + (len >> 1)) / len);
+            v = (uint16_t)(n - on);
+        }
+        frame[1 + ch] = v;
+    }
+}
+
+/*********************************************************************
+ * @fn      set_pwm_spread_report
+ *
+ * @brief   Store average frequency, its error and the jitter in the handles of a group
+ * 
+ * @param   group       Pointer to initialized PWM_group struct
+ * @param   periods     Number of periods averaged over
+ * @param   counts      Timer counts of these periods
+ * @param   jitter      Peak cycle-to-cycle period change in ps
+ *
+ * @return  None
+ */
+static void set_pwm_spread_report(PWM_group *group, uint32_t periods, uint64_t counts, uint32_t jitter)
+{
+    uint64_t num = (uint64_t)get_pwm_clock(group->timer) * periods;
+    for (uint8_t k = 0; k < group->count; k++)
+    {
+        PWM_handle *h = group->channels[k];
+        uint64_t div = ((uint64_t)h->prescaler + 1) * counts;
+        uint64_t f = (num * 1000 + (div >> 1)) / div;
+        h->f_avg_millihz = (f > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)f;
+        h->f_actual = (uint32_t)((num + (div >> 1)) / div);
+        h->f_error_ppm = (h->f_base == 0) ? 0 : (int32_t)(((int64_t)num - (int64_t)h->f_base * (int64_t)div) * 1000000LL / ((int64_t)h->f_base * (int64_t)div));
+        h->jitter_ps = jitter;
+    }
+}
+
+/*********************************************************************
+ * @fn      enable_pwm_spread
+ *
+ * @brief   Spread the carrier spectrum of a group (e.g. against conducted emissions at the switching
+ *          frequency) by modulating the timer period with a triangular or pseudo-random profile.
+ *          The compare values are rescaled for every period, so duty cycles stay constant.
+ *          One burst frame {ATRLR, RPTCR, CH1CVR ... last channel} per period is precomputed into
+ *          buffer and streamed by DMA, so there is no CPU load while spreading.
+ *          The group should contain all channels of the timer, compare registers of other channels
+ *          below the group keep their value. Duty cycle changes need another call of this function.
+ *          f_avg_millihz, f_actual and f_error_ppm of the group's handles are set to the average over
+ *          the profile, jitter_ps to the peak cycle-to-cycle period change.
+ * 
+ * @param   group           Pointer to initialized PWM_group struct
+ * @param   spread_permille Peak deviation of the period in 1/1000 (e.g. 20 = +-2%, 1 - 200)
+ * @param   f_mod           Modulation (profile repetition) frequency in Hz, has to be below half the carrier frequency
+ * @param   profile         PWM_SPREAD_TRIANGLE or PWM_SPREAD_RANDOM
+ * @param   buffer          Buffer for the frames, has to stay valid while spreading
+ * @param   size            Size of buffer in half-words, at least (f_carrier / f_mod) * (2 + last channel),
+ *                          twice that for center-aligned timers updating at top and bottom
+ *
+ * @return  PWM_OK on success, PWM_ERR_TIMER if the timer has no DMA request mapping, PWM_ERR_RANGE
+ *          if an argument is invalid, the buffer is too small or the spread exceeds the timer's range,
+ *          PWM_ERR_BUSY if the DMA channel is in use, the period is dithered (see enable_pwm_freq_dither())
+ *          or the timer is cascaded (see init_pwm_cascade())
+ */
+int enable_pwm_spread(PWM_group *group, uint16_t spread_permille, uint32_t f_mod, uint8_t profile, uint16_t *buffer, uint16_t size)
+{
+    if (group->tim == NULL || get_pwm_dma_channel(group->timer) == NULL) return PWM_ERR_TIMER;
+    if (spread_permille == 0 || spread_permille > 200 || f_mod == 0 || profile > PWM_SPREAD_RANDOM || buffer == NULL) return PWM_ERR_RANGE;
+    if (is_pwm_stream_active(group->timer) || is_pwm_freq_dither_active(group->timer) || is_pwm_cascaded(group->timer)) return PWM_ERR_BUSY;
+
+    // ---------- Nominal period, deviation and profile length ----------
+    PWM_handle *ref = group->channels[0];
+    uint32_t n_nom = (uint32_t)ref->arr + 1;
+    uint32_t dev = (n_nom * spread_permille + 500) / 1000;                  // Peak deviation in counts
+    uint16_t min_counts = 0;
+    for (uint8_t k = 0; k < group->count; k++)
+    {
+        if (group->channels[k]->period > min_counts) min_counts = group->channels[k]->period;
+    }
+    if (dev == 0 || n_nom + dev > 65536 || n_nom - dev <= min_counts) return PWM_ERR_RANGE;
+    uint32_t f_clk = get_pwm_clock(group->timer);
+    uint64_t n_clk = ((uint64_t)ref->prescaler + 1) * n_nom;
+    uint64_t f_frames = (uint64_t)f_clk * get_pwm_updates(group->timer);    // One frame per update event
+    uint32_t length = (uint32_t)((f_frames + (n_clk * f_mod >> 1)) / (n_clk * f_mod));  // Frames per profile
+    uint8_t last = group->first + group->count - 1;
+    uint8_t words = 2 + last;                                               // ATRLR, RPTCR, CH1CVR ... CHlastCVR
+    if (length < 2 || length * words > size) return PWM_ERR_RANGE;
+
+    // ---------- Precompute frames ----------
+    uint16_t lfsr = 0xACE1;
+    uint32_t n_prev = 0, step_max = 0;
+    uint64_t n_sum = 0;
+    for (uint32_t i = 0; i < length; i++)
+    {
+        int32_t d;
+        if (profile == PWM_SPREAD_TRIANGLE)
+        {
+            // -dev -> +dev in the first half, back to -dev in the second half
+            int64_t x = (int64_t)4 * dev * i / length;
+            d = (int32_t)((i < length / 2) ? x - dev : 3 * (int64_t)dev - x);
+        }
+        else
+        {
+            lfsr = (lfsr >> 1) ^ (-(lfsr & 1) & 0xB400);                   // 16-Bit Galois LFSR, period 65535
+            d = (int32_t)(((int64_t)lfsr * (2 * dev + 1)) >> 16) - (int32_t)dev;
+        }
+        uint32_t n = n_nom + d;
+        put_pwm_group_frame(group, &buffer[i * words], n, 0);
+        if (i > 0)
+        {
+            uint32_t step = (n > n_prev) ? n - n_prev : n_prev - n;
+            if (step > step_max) step_max = step;
+        }
+        n_prev = n;
+        n_sum += n;
+    }
+
+    // ---------- Stream one frame per period by DMA burst ----------
+    uint32_t jitter = (uint32_t)(((uint64_t)step_max * ((uint32_t)ref->prescaler + 1) * 1000000000000ULL + (f_clk >> 1)) / f_clk);
+    set_pwm_spread_report(group, length, n_sum, jitter);
+    for (uint8_t k = 0; k < group->count; k++) set_pwm_preload(group->channels[k], ENABLE);
+    TIM_DMAConfig(group->tim, TIM_DMABase_ARR, (uint16_t)((words - 1) << 8));
+    return start_pwm_dma(group->timer, &group->tim->DMAADR, buffer, (uint16_t)(length * words), PWM_STREAM_CIRCULAR, NULL);
+}
+
+/*********************************************************************
+ * @fn      disable_pwm_spread
+ *
+ * @brief   Stop spreading, the group returns to its nominal period and duty cycles,
+ *          frequency reports of the handles to the nominal period
+ * 
+ * @param   group       Pointer to PWM_group struct
+ *
+ * @return  None
+ */
+void disable_pwm_spread(PWM_group *group)
+{
+    if (group->tim == NULL) return;
+    stop_pwm_stream(group->timer);
+    group->tim->ATRLR = group->channels[0]->arr + ((group->tim->CTLR1 & TIM_CMS) != 0);
+    for (uint8_t k = 0; k < group->count; k++) *group->channels[k]->ccr = group->channels[k]->duty_cycle;
+    set_pwm_spread_report(group, 1, (uint64_t)group->channels[0]->arr + 1, 0);
+}
+
+/*********************************************************************
+ * @fn      stop_pwm_stream
+ *
+ * @brief   Stop the DMA stream (or group stream) of a timer. The last transferred values stay active.
+ * 
+ * @param   iTimer      Timer (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ *
+ * @return  None
+ */
+void stop_pwm_stream(uint8_t iTimer)
+{
+    DMA_Channel_TypeDef *ch = get_pwm_dma_channel(iTimer);
+    if (ch == NULL) return;
+    TIM_DMACmd(get_pwm_timer(iTimer), TIM_DMA_Update, DISABLE);
+    DMA_ITConfig(ch, DMA_IT_TC | DMA_IT_HT, DISABLE);
+    DMA_Cmd(ch, DISABLE);
+    pwm_stream_state[iTimer].callback = NULL;
+}
+
+/*********************************************************************
+ * @fn      pwm_dma_irq_handler
+ *
+ * @brief   Handle DMA interrupt of a timer stream and invoke its callback with the part of the
+ *          buffer that may be refilled. Call this from the DMA channel's interrupt handler, e.g.
+ *          void DMA1_Channel5_IRQHandler(void) { pwm_dma_irq_handler(PWM_TIM1); }
+ * 
+ * @param   iTimer      Timer (PWM_TIM1, PWM_TIM2, PWM_TIM3 or PWM_TIM4)
+ *
+ * @return  None
+ */
+void pwm_dma_irq_handler(uint8_t iTimer)
+{
+    uint8_t n = get_pwm_dma_number(iTimer);
+    if (n == 0) return;
+    PWM_stream_state *state = &pwm_stream_state[iTimer];
+    uint8_t shift = (n - 1) * 4;
+    uint32_t flags = DMA1->INTFR >> shift;
+    DMA1->INTFCR = (flags & (DMA1_FLAG_GL1 | DMA1_FLAG_TC1 | DMA1_FLAG_HT1 | DMA1_FLAG_TE1)) << shift;
+    uint16_t half = state->length / 2;
+    if ((flags & DMA1_FLAG_HT1) && state->mode == PWM_STREAM_PINGPONG)
+    {
+        if (state->callback) state->callback(iTimer, state->buffer, half);
+    }
+    if (flags & DMA1_FLAG_TC1)
+    {
+        if (state->mode == PWM_STREAM_ONESHOT) TIM_DMACmd(get_pwm_timer(iTimer), TIM_DMA_Update, DISABLE);
+        if (state->mode == PWM_STREAM_PINGPONG)
+        {
+            if (state->callback) state->callback(iTimer, state->buffer + half, state->length - half);
+        }
+        else
+        {
+            if (state->callback) state->callback(iTimer, state->buffer, state->length);
+        }
+    }
+}
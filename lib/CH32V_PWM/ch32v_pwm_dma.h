@@ -0,0 +1,92 @@
+/**
+ *  CH32VX PWM Library
+ *
+ *  Copyright (c) 2024 Florian Korotschenko aka KingKoro
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ *
+ *
+ *  file         : ch32v_pwm_dma.h
+ *  description  : ch32v pwm library DMA streaming header
+ *
+ */
+
+#ifndef __CH32V_PWM_DMA_H
+#define __CH32V_PWM_DMA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "ch32v_pwm.h"
+
+// Stream modes
+#define PWM_STREAM_ONESHOT  0   // Play buffer once, callback when done
+#define PWM_STREAM_CIRCULAR 1   // Repeat buffer endlessly, callback at end of every pass
+#define PWM_STREAM_PINGPONG 2   // Repeat buffer endlessly, callback with the half that just finished playing (to refill it)
+
+// Spread spectrum profiles
+#define PWM_SPREAD_TRIANGLE 0   // Period sweeps linearly between -spread and +spread and back
+#define PWM_SPREAD_RANDOM   1   // Period takes pseudo-random values (LFSR) between -spread and +spread
+
+// Callback for DMA streams, receives timer number and the part of the buffer that may be refilled
+typedef void (*pwm_stream_callback)(uint8_t iTimer, uint16_t *buffer, uint16_t count);
+
+// Group of neighbouring channels of one timer, updated together by DMA burst
+typedef struct
+{
+    uint8_t timer;          // Timer of all channels
+    uint8_t first;          // Lowest channel (PWM_CH1 ... PWM_CH4)
+    uint8_t count;          // Number of channels (values per frame)
+    TIM_TypeDef *tim;       // Registers of Timer (resolved at init)
+    PWM_handle *channels[4];    // Channels in frame order
+} PWM_group;
+
+// Get DMA channel serving the update request of a timer (NULL if not available)
+DMA_Channel_TypeDef *get_pwm_dma_channel(uint8_t iTimer);
+// Function to stream a buffer into any register of a timer, one value per update event
+extern int start_pwm_dma(uint8_t iTimer, __IO uint16_t *dst, uint16_t *buffer, uint16_t length, uint8_t mode, pwm_stream_callback callback);
+// Function to convert duty cycles into compare register values for a stream buffer (in place allowed)
+extern void convert_pwm_dutycycles(PWM_handle *object, uint16_t *buffer, const uint16_t duties[], uint16_t count);
+// Function to stream compare register values from a buffer into a channel, one value per timer period
+extern int start_pwm_stream(PWM_handle *object, uint16_t *buffer, uint16_t length, uint8_t mode, pwm_stream_callback callback);
+// Function to stop the DMA stream of a timer, the last value stays active
+extern void stop_pwm_stream(uint8_t iTimer);
+// Function to check if the DMA stream of a timer is running
+extern uint8_t is_pwm_stream_active(uint8_t iTimer);
+// Function to combine neighbouring channels of a timer into a group for DMA bursts
+extern int init_pwm_group(PWM_group *group, PWM_handle *objects[], uint8_t count);
+// Function to convert interleaved duty cycle frames into compare register values (in place allowed)
+extern void convert_pwm_group_frames(PWM_group *group, uint16_t *buffer, const uint16_t duties[], uint16_t frames);
+// Function to stream interleaved frames into all channels of a group, one frame per timer period
+extern int start_pwm_group_stream(PWM_group *group, uint16_t *buffer, uint16_t frames, uint8_t mode, pwm_stream_callback callback);
+// Write the frame {ATRLR, RPTCR, CH1CVR ... last channel} of one period for DMA bursts, compare values rescaled to the period
+void put_pwm_group_frame(PWM_group *group, uint16_t *frame, uint32_t n, uint8_t half);
+// Function to spread the carrier spectrum of a group by modulating the timer period with constant duty cycles
+extern int enable_pwm_spread(PWM_group *group, uint16_t spread_permille, uint32_t f_mod, uint8_t profile, uint16_t *buffer, uint16_t size);
+// Function to return a group to its nominal carrier frequency
+extern void disable_pwm_spread(PWM_group *group);
+// Interrupt handler, call from the DMA channel interrupt handler of the timer (e.g. DMA1_Channel5_IRQHandler for TIM1)
+extern void pwm_dma_irq_handler(uint8_t iTimer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
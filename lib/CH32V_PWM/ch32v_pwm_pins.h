@@ -0,0 +1,125 @@
+/**
+ *  CH32VX PWM Library
+ *
+ *  Copyright (c) 2024 Florian Korotschenko aka KingKoro
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ *
+ *
+ *  file         : ch32v_pwm_pins.h
+ *  description  : pin to timer/channel/remap tables per MCU, used by init_pwm_pin()
+ *
+ */
+
+#ifndef __CH32V_PWM_PINS_H
+#define __CH32V_PWM_PINS_H
+
+/*
+ * Every PWM capable pin is described by one macro PWM_PIN_<pin>, expanding to
+ * "timer, channel, pin code, remap". init_pwm_pin(&h, PA8, ...) pastes the pin
+ * name into this macro, so all values are constants and a pin without PWM
+ * function (or not available on the selected MCU) fails to compile with
+ * "'PWM_PIN_xxx' undeclared".
+ *
+ * The remap word holds the AFIO PCFR1 bits the pin depends on (upper half) and
+ * their required value (lower half). Channels of the same timer can share a
+ * remap setting as long as their required bits don't contradict each other,
+ * e.g. TIM2 on PA15 (CH1) and PB10 (CH3) results in the full remap.
+ */
+#define PWM_REMAP(mask, value)  (((uint32_t)(mask) << 16) | (uint32_t)(value))
+#define PWM_REMAP_NONE          0
+
+// Entry of PWM_PIN_TABLE
+typedef struct
+{
+    uint8_t timer;          // PWM_TIM1 ... PWM_TIM4
+    uint8_t channel;        // PWM_CH1 ... PWM_CH4
+    uint16_t pin;           // Pin code (e.g. 0x0A08 for PA8)
+    uint32_t remap;         // AFIO remap requirement, see PWM_REMAP()
+} PWM_pin_entry;
+
+#if defined(CH32V10X) || defined(CH32V20X) || defined(CH32V30X)
+
+// ---------- TIM1 (TIM1_RM = 00 or 01 (partial remap only moves BKIN/CHxN), full remap to port E not supported) ----------
+#define PWM_PIN_PA8     PWM_TIM1, PWM_CH1, 0x0A08, PWM_REMAP(0x0080, 0x0000)
+#define PWM_PIN_PA9     PWM_TIM1, PWM_CH2, 0x0A09, PWM_REMAP(0x0080, 0x0000)
+#define PWM_PIN_PA10    PWM_TIM1, PWM_CH3, 0x0A0A, PWM_REMAP(0x0080, 0x0000)
+#define PWM_PIN_PA11    PWM_TIM1, PWM_CH4, 0x0A0B, PWM_REMAP(0x0080, 0x0000)
+
+// ---------- TIM2 (TIM2_RM bit 8 moves CH1/CH2, bit 9 moves CH3/CH4) ----------
+#define PWM_PIN_PA0     PWM_TIM2, PWM_CH1, 0x0A00, PWM_REMAP(0x0100, 0x0000)
+#define PWM_PIN_PA1     PWM_TIM2, PWM_CH2, 0x0A01, PWM_REMAP(0x0100, 0x0000)
+#define PWM_PIN_PA15    PWM_TIM2, PWM_CH1, 0x0A0F, PWM_REMAP(0x0100, 0x0100)
+#define PWM_PIN_PB3     PWM_TIM2, PWM_CH2, 0x0B03, PWM_REMAP(0x0100, 0x0100)
+#define PWM_PIN_PA2     PWM_TIM2, PWM_CH3, 0x0A02, PWM_REMAP(0x0200, 0x0000)
+#define PWM_PIN_PA3     PWM_TIM2, PWM_CH4, 0x0A03, PWM_REMAP(0x0200, 0x0000)
+#define PWM_PIN_PB10    PWM_TIM2, PWM_CH3, 0x0B0A, PWM_REMAP(0x0200, 0x0200)
+#define PWM_PIN_PB11    PWM_TIM2, PWM_CH4, 0x0B0B, PWM_REMAP(0x0200, 0x0200)
+
+// ---------- TIM3 (TIM3_RM = 00 default, 10 partial remap, 11 full remap) ----------
+#define PWM_PIN_PA6     PWM_TIM3, PWM_CH1, 0x0A06, PWM_REMAP(0x0C00, 0x0000)
+#define PWM_PIN_PA7     PWM_TIM3, PWM_CH2, 0x0A07, PWM_REMAP(0x0C00, 0x0000)
+#define PWM_PIN_PB4     PWM_TIM3, PWM_CH1, 0x0B04, PWM_REMAP(0x0C00, 0x0800)
+#define PWM_PIN_PB5     PWM_TIM3, PWM_CH2, 0x0B05, PWM_REMAP(0x0C00, 0x0800)
+#define PWM_PIN_PB0     PWM_TIM3, PWM_CH3, 0x0B00, PWM_REMAP(0x0400, 0x0000)    // default or partial remap
+#define PWM_PIN_PB1     PWM_TIM3, PWM_CH4, 0x0B01, PWM_REMAP(0x0400, 0x0000)    // default or partial remap
+#define PWM_PIN_PC6     PWM_TIM3, PWM_CH1, 0x0C06, PWM_REMAP(0x0C00, 0x0C00)
+#define PWM_PIN_PC7     PWM_TIM3, PWM_CH2, 0x0C07, PWM_REMAP(0x0C00, 0x0C00)
+#define PWM_PIN_PC8     PWM_TIM3, PWM_CH3, 0x0C08, PWM_REMAP(0x0C00, 0x0C00)
+#define PWM_PIN_PC9     PWM_TIM3, PWM_CH4, 0x0C09, PWM_REMAP(0x0C00, 0x0C00)
+
+// ---------- TIM4 (TIM4_RM bit 12) ----------
+#define PWM_PIN_PB6     PWM_TIM4, PWM_CH1, 0x0B06, PWM_REMAP(0x1000, 0x0000)
+#define PWM_PIN_PB7     PWM_TIM4, PWM_CH2, 0x0B07, PWM_REMAP(0x1000, 0x0000)
+#define PWM_PIN_PB8     PWM_TIM4, PWM_CH3, 0x0B08, PWM_REMAP(0x1000, 0x0000)
+#define PWM_PIN_PB9     PWM_TIM4, PWM_CH4, 0x0B09, PWM_REMAP(0x1000, 0x0000)
+#if defined(CH32V30X)
+// PD12 - PD15 are only bonded out on the larger CH32V30x packages
+#define PWM_PIN_PD12    PWM_TIM4, PWM_CH1, 0x0D0C, PWM_REMAP(0x1000, 0x1000)
+#define PWM_PIN_PD13    PWM_TIM4, PWM_CH2, 0x0D0D, PWM_REMAP(0x1000, 0x1000)
+#define PWM_PIN_PD14    PWM_TIM4, PWM_CH3, 0x0D0E, PWM_REMAP(0x1000, 0x1000)
+#define PWM_PIN_PD15    PWM_TIM4, PWM_CH4, 0x0D0F, PWM_REMAP(0x1000, 0x1000)
+#endif
+
+// Table of all pins above, e.g. for const PWM_pin_entry pins[] = { PWM_PIN_TABLE };
+#if defined(CH32V30X)
+#define PWM_PIN_TABLE_TIM4_REMAP \
+    {PWM_PIN_PD12}, {PWM_PIN_PD13}, {PWM_PIN_PD14}, {PWM_PIN_PD15},
+#else
+#define PWM_PIN_TABLE_TIM4_REMAP
+#endif
+#define PWM_PIN_TABLE \
+    {PWM_PIN_PA8},  {PWM_PIN_PA9},  {PWM_PIN_PA10}, {PWM_PIN_PA11}, \
+    {PWM_PIN_PA0},  {PWM_PIN_PA1},  {PWM_PIN_PA2},  {PWM_PIN_PA3}, \
+    {PWM_PIN_PA15}, {PWM_PIN_PB3},  {PWM_PIN_PB10}, {PWM_PIN_PB11}, \
+    {PWM_PIN_PA6},  {PWM_PIN_PA7},  {PWM_PIN_PB0},  {PWM_PIN_PB1}, \
+    {PWM_PIN_PB4},  {PWM_PIN_PB5},  {PWM_PIN_PC6},  {PWM_PIN_PC7}, \
+    {PWM_PIN_PC8},  {PWM_PIN_PC9}, \
+    {PWM_PIN_PB6},  {PWM_PIN_PB7},  {PWM_PIN_PB8},  {PWM_PIN_PB9}, \
+    PWM_PIN_TABLE_TIM4_REMAP
+
+#elif defined(CH32X035) || defined(CH32X033)
+
+// ---------- No tables: CH32X035 has its own TIM1 - TIM3 pinout and PCFR1 remap layout, not mapped yet ----------
+// init_pwm_pin(), init_pwm_any() and the C++ Pwm template fail with a message, use init_pwm() with timer, channel and pin code
+#define PWM_PIN_TABLE_NONE
+
+#endif
+
+#endif
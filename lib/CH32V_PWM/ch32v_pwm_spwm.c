@@ -0,0 +1,259 @@
+/**
+ *  CH32VX PWM Library
+ *
+ *  Copyright (c) 2024 Florian Korotschenko aka KingKoro
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ *
+ *
+ *  file         : ch32v_pwm_spwm.c
+ *  description  : ch32v pwm library sine PWM (SPWM) generator
+ *
+ */
+
+#include "ch32v_pwm_spwm.h"
+
+#if PWM_SINE_LUT_BITS < 2 || PWM_SINE_LUT_BITS > 12 || PWM_SINE_LUT_Q < 1 || PWM_SINE_LUT_Q > 15
+    #error "PWM_SINE_LUT_BITS has to be 2 - 12 and PWM_SINE_LUT_Q 1 - 15"
+#endif
+
+#define PWM_SINE_LUT_SIZE   (1 << PWM_SINE_LUT_BITS)
+
+static int16_t pwm_sine_lut[PWM_SINE_LUT_SIZE];
+static uint8_t pwm_sine_lut_ready = 0;
+
+// Generator streaming on a timer (index = PWM_TIMx), looked up by the DMA callback
+static PWM_spwm *pwm_spwm_active[PWM_TIM4 + 1];
+
+/*********************************************************************
+ * @fn      init_pwm_sine_lut
+ *
+ * @brief   Fill the sine table, one full turn in PWM_SINE_LUT_SIZE steps. Entries are calculated
+ *          without FPU by a 9th order Taylor series in Q30 over a quarter turn (error < 4e-6)
+ *          and mirrored into the other quadrants.
+ * 
+ * @return  None
+ */
+static void init_pwm_sine_lut(void)
+{
+    const int64_t one = (int64_t)1 << 30;
+    const int64_t half_pi = 1686629713;                         // pi / 2 in Q30
+    const uint32_t quarter = PWM_SINE_LUT_SIZE / 4;
+    for (uint32_t i = 0; i < PWM_SINE_LUT_SIZE; i++)
+    {
+        uint32_t quadrant = i / quarter;
+        uint32_t j = i % quarter;
+        if (quadrant & 1) j = quarter - j;                      // Falling quarter mirrors rising quarter
+        int64_t x = half_pi * j / quarter;
+        int64_t x2 = (x * x) >> 30;
+        // sin(x) = x * (1 - x^2/6 * (1 - x^2/20 * (1 - x^2/42 * (1 - x^2/72))))
+        int64_t t = one - x2 / 72;
+        t = one - ((x2 * t) >> 30) / 42;
+        t = one - ((x2 * t) >> 30) / 20;
+        t = one - ((x2 * t) >> 30) / 6;
+        int64_t s = (x * t) >> 30;
+        int32_t v = (int32_t)((s * ((1 << PWM_SINE_LUT_Q) - 1) + (one >> 1)) >> 30);
+        pwm_sine_lut[i] = (int16_t)((quadrant >= 2) ? -v : v);
+    }
+    pwm_sine_lut_ready = 1;
+}
+
+/*********************************************************************
+ * @fn      get_pwm_sine
+ *
+ * @brief   Get sine of a phase angle from the lookup table (nearest lower entry)
+ * 
+ * @param   phase       Angle as fraction of a full turn (0x100000000 = 360 degrees)
+ *
+ * @return  Sine in Q(PWM_SINE_LUT_Q), amplitude 2^PWM_SINE_LUT_Q - 1
+ */
+int16_t get_pwm_sine(uint32_t phase)
+{
+    if (!pwm_sine_lut_ready) init_pwm_sine_lut();
+    return pwm_sine_lut[phase >> (32 - PWM_SINE_LUT_BITS)];
+}
+
+/*********************************************************************
+ * @fn      fill_pwm_spwm
+ *
+ * @brief   Calculate the next frames of a sine PWM generator, advancing its phase accumulator.
+ *          Duty cycle of each output is (1 + index * sin(phase)) / 2.
+ * 
+ * @param   spwm        Pointer to PWM_spwm struct
+ * @param   buffer      Destination for frames * group->count compare values
+ * @param   frames      Number of frames
+ *
+ * @return  None
+ */
+static void fill_pwm_spwm(PWM_spwm *spwm, uint16_t *buffer, uint16_t frames)
+{
+    PWM_group *group = spwm->group;
+    uint32_t len = (uint32_t)group->channels[0]->arr + 1;      // Counts per period, same for all channels of the timer
+    uint32_t phase = spwm->phase;
+    uint32_t increment = spwm->increment;
+    int32_t index = spwm->index;
+    for (uint16_t f = 0; f < frames; f++)
+    {
+        uint32_t p = phase;
+        for (uint8_t k = 0; k < group->count; k++)
+        {
+            int32_t s = ((int32_t)pwm_sine_lut[p >> (32 - PWM_SINE_LUT_BITS)] * index) >> 15;
+            uint32_t on = (len * (uint32_t)((1 << PWM_SINE_LUT_Q) + s)) >> (PWM_SINE_LUT_Q + 1);
+            *buffer++ = (uint16_t)(len - on);
+            p -= PWM_PHASE_120;                                 // Next output lags by 120 degrees
+        }
+        phase += increment;
+    }
+    spwm->phase = phase;
+}
+
+/*********************************************************************
+ * @fn      refill_pwm_spwm
+ *
+ * @brief   DMA callback, refills the half of the buffer that just finished playing
+ * 
+ * @param   iTimer      Timer of the stream
+ * @param   buffer      Part of the buffer to refill
+ * @param   count       Number of compare values to refill
+ *
+ * @return  None
+ */
+static void refill_pwm_spwm(uint8_t iTimer, uint16_t *buffer, uint16_t count)
+{
+    PWM_spwm *spwm = pwm_spwm_active[iTimer];
+    if (spwm) fill_pwm_spwm(spwm, buffer, count / spwm->group->count);
+}
+
+/*********************************************************************
+ * @fn      init_pwm_spwm
+ *
+ * @brief   Initialize a sine PWM generator on a group of 1 - 3 channels (e.g. TIM1 CH1 - CH3 for a
+ *          three-phase inverter). A DDS phase accumulator advances by a 32-Bit step each carrier period,
+ *          outputs B and C lag output A by 120 and 240 degrees. Starts with frequency and modulation
+ *          index 0 (all outputs at 50% duty cycle).
+ * 
+ * @param   spwm        Pointer to PWM_spwm struct to initialize
+ * @param   group       Pointer to initialized PWM_group struct, has to stay valid
+ * @param   buffer      Buffer for frames * group->count compare values, has to stay valid
+ * @param   frames      Number of carrier periods in buffer (even, at least 2), half of it is refilled at once
+ *
+ * @return  PWM_OK on success, PWM_ERR_TIMER if the timer has no DMA request mapping,
+ *          PWM_ERR_RANGE if the group has more than 3 channels or buffer/frames are invalid
+ */
+int init_pwm_spwm(PWM_spwm *spwm, PWM_group *group, uint16_t *buffer, uint16_t frames)
+{
+    if (group == NULL || group->tim == NULL || get_pwm_dma_channel(group->timer) == NULL) return PWM_ERR_TIMER;
+    if (group->count > 3 || buffer == NULL || frames < 2 || (frames & 1) || (uint32_t)frames * group->count > 0xFFFF) return PWM_ERR_RANGE;
+    if (!pwm_sine_lut_ready) init_pwm_sine_lut();
+    spwm->group = group;
+    spwm->buffer = buffer;
+    spwm->frames = frames;
+    spwm->phase = 0;
+    spwm->increment = 0;
+    spwm->index = 0;
+    spwm->f_millihz = 0;
+    return PWM_OK;
+}
+
+/*********************************************************************
+ * @fn      set_pwm_spwm_frequency
+ *
+ * @brief   Set the output frequency of a sine PWM generator. The phase step is
+ *          f * 2^32 / f_update, so the resolution is f_update / 2^32 (e.g. 5uHz at 20kHz).
+ *          f_update is the carrier frequency, doubled for center-aligned timers updating at top and bottom.
+ *          Running generators pick up the new step at the next buffer refill without phase jump.
+ * 
+ * @param   spwm        Pointer to initialized PWM_spwm struct
+ * @param   f_millihz   Output frequency in mHz, negative values reverse the phase sequence (A-C-B)
+ *
+ * @return  PWM_OK on success, PWM_ERR_RANGE if |f| is not below half the update frequency
+ */
+int set_pwm_spwm_frequency(PWM_spwm *spwm, int32_t f_millihz)
+{
+    PWM_handle *ref = spwm->group->channels[0];
+    uint64_t den = (uint64_t)get_pwm_clock(spwm->group->timer) * 1000 * get_pwm_updates(spwm->group->timer);     // One step per update event
+    uint32_t f = (f_millihz < 0) ? (uint32_t)(-(int64_t)f_millihz) : (uint32_t)f_millihz;
+    uint64_t num = (uint64_t)f * (((uint64_t)ref->prescaler + 1) * ((uint64_t)ref->arr + 1));
+    // increment = num * 2^32 / den, divided in 16-Bit steps to stay within 64 Bit
+    if (num / den != 0) return PWM_ERR_RANGE;
+    uint64_t rem = num << 16;
+    uint32_t hi = (uint32_t)(rem / den);
+    rem = (rem % den) << 16;
+    uint32_t increment = (hi << 16) + (uint32_t)((rem + (den >> 1)) / den);
+    if (increment >= 0x80000000UL) return PWM_ERR_RANGE;
+    spwm->f_millihz = f_millihz;
+    spwm->increment = (f_millihz < 0) ? (uint32_t)(-(int32_t)increment) : increment;
+    return PWM_OK;
+}
+
+/*********************************************************************
+ * @fn      set_pwm_spwm_index
+ *
+ * @brief   Set the modulation index (amplitude) of a sine PWM generator. Running generators
+ *          pick up the new index at the next buffer refill.
+ * 
+ * @param   spwm        Pointer to initialized PWM_spwm struct
+ * @param   index       Modulation index in Q15 (0 = 50% duty cycle, PWM_SPWM_INDEX_MAX = 0 - 100%)
+ *
+ * @return  None
+ */
+void set_pwm_spwm_index(PWM_spwm *spwm, uint16_t index)
+{
+    spwm->index = (index > PWM_SPWM_INDEX_MAX) ? PWM_SPWM_INDEX_MAX : index;
+}
+
+/*********************************************************************
+ * @fn      start_pwm_spwm
+ *
+ * @brief   Start streaming sine samples into the group, one frame per carrier period by DMA burst
+ *          (see start_pwm_group_stream()). The CPU only refills half of the buffer at a time from
+ *          pwm_dma_irq_handler(), which has to be forwarded from the DMA channel's interrupt handler.
+ *          Frequency and index changes take effect within half a buffer.
+ * 
+ * @param   spwm        Pointer to initialized PWM_spwm struct
+ *
+ * @return  PWM_OK on success, PWM_ERR_BUSY if the DMA channel is in use
+ */
+int start_pwm_spwm(PWM_spwm *spwm)
+{
+    PWM_group *group = spwm->group;
+    if (is_pwm_stream_active(group->timer)) return PWM_ERR_BUSY;
+    fill_pwm_spwm(spwm, spwm->buffer, spwm->frames);
+    pwm_spwm_active[group->timer] = spwm;
+    int ret = start_pwm_group_stream(group, spwm->buffer, spwm->frames, PWM_STREAM_PINGPONG, refill_pwm_spwm);
+    if (ret != PWM_OK) pwm_spwm_active[group->timer] = NULL;
+    return ret;
+}
+
+/*********************************************************************
+ * @fn      stop_pwm_spwm
+ *
+ * @brief   Stop a sine PWM generator, the outputs keep their last duty cycle.
+ *          The phase is kept, so start_pwm_spwm() continues the waveform.
+ * 
+ * @param   spwm        Pointer to PWM_spwm struct
+ *
+ * @return  None
+ */
+void stop_pwm_spwm(PWM_spwm *spwm)
+{
+    if (pwm_spwm_active[spwm->group->timer] != spwm) return;
+    stop_pwm_stream(spwm->group->timer);
+    pwm_spwm_active[spwm->group->timer] = NULL;
+}
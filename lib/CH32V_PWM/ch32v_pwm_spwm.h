@@ -0,0 +1,89 @@
+/**
+ *  CH32VX PWM Library
+ *
+ *  Copyright (c) 2024 Florian Korotschenko aka KingKoro
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ *
+ *
+ *  file         : ch32v_pwm_spwm.h
+ *  description  : ch32v pwm library sine PWM (SPWM) generator header
+ *
+ */
+
+#ifndef __CH32V_PWM_SPWM_H
+#define __CH32V_PWM_SPWM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "ch32v_pwm_dma.h"
+
+/* ++++++++++++++++++++ USER CONFIG AREA BEGIN ++++++++++++++++++++ */
+
+#define PWM_SINE_LUT_BITS       8                   /* Sine table size as power of 2 (2 - 12, 8 = 256 entries), finer tables reduce harmonic distortion */
+#define PWM_SINE_LUT_Q          15                  /* Fractional bits of sine table entries (1 - 15, 15 = Q15 with amplitude 32767) */
+
+/* ++++++++++++++++++++ USER CONFIG AREA END ++++++++++++++++++++ */
+
+#ifndef PWM_SINE_LUT_BITS
+    #define PWM_SINE_LUT_BITS 8
+#endif
+#ifndef PWM_SINE_LUT_Q
+    #define PWM_SINE_LUT_Q 15
+#endif
+
+// Phase angles as fraction of a full turn (32-Bit, 0x100000000 = 360 degrees)
+#define PWM_PHASE_120   0x55555555UL
+#define PWM_PHASE_240   0xAAAAAAABUL
+
+// Modulation index of full amplitude (Q15)
+#define PWM_SPWM_INDEX_MAX  32768
+
+// State of a sine PWM generator, outputs of the group are phase A, B (-120 degrees), C (-240 degrees)
+typedef struct
+{
+    PWM_group *group;               // 1 - 3 neighbouring channels (e.g. TIM1 CH1 - CH3)
+    uint16_t *buffer;               // Ping-pong buffer of frames * group->count compare values
+    uint16_t frames;                // Number of frames (carrier periods) in buffer
+    uint32_t phase;                 // DDS phase accumulator of phase A
+    volatile uint32_t increment;    // Phase step per carrier period
+    volatile uint16_t index;        // Modulation index (Q15, PWM_SPWM_INDEX_MAX = full amplitude)
+    int32_t f_millihz;              // Requested output frequency in mHz (negative = reversed phase sequence)
+} PWM_spwm;
+
+// Get sine of a phase angle (0x100000000 = 360 degrees) from the lookup table in Q(PWM_SINE_LUT_Q)
+extern int16_t get_pwm_sine(uint32_t phase);
+// Function to initialize a sine PWM generator on a group of channels
+extern int init_pwm_spwm(PWM_spwm *spwm, PWM_group *group, uint16_t *buffer, uint16_t frames);
+// Function to set the output frequency in mHz, takes effect on the fly
+extern int set_pwm_spwm_frequency(PWM_spwm *spwm, int32_t f_millihz);
+// Function to set the modulation index (Q15), takes effect on the fly
+extern void set_pwm_spwm_index(PWM_spwm *spwm, uint16_t index);
+// Function to start streaming sine samples by DMA
+extern int start_pwm_spwm(PWM_spwm *spwm);
+// Function to stop a sine PWM generator, outputs keep their last duty cycle
+extern void stop_pwm_spwm(PWM_spwm *spwm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,178 @@
+/**
+ *  CH32VX PWM Library
+ *
+ *  Copyright (c) 2024 Florian Korotschenko aka KingKoro
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ *
+ *
+ *  file         : ch32v_pwm_svm.c
+ *  description  : ch32v pwm library space vector modulation (SVM)
+ *
+ */
+
+#include "ch32v_pwm_svm.h"
+
+#define PWM_SVM_SQRT3_2     28378   // sqrt(3) / 2 in Q15
+
+// Sector by sign code (beta > 0) << 2 | (w > 0) << 1 | (y > 0), codes 1 and 6 only occur by rounding at boundaries
+static const uint8_t pwm_svm_sectors[8] = {4, 2, 5, 6, 3, 2, 1, 1};
+// Phases (0 = A, 1 = B, 2 = C) with longest, medium and shortest on time per sector
+static const uint8_t pwm_svm_order[7][3] = {{0, 1, 2}, {0, 1, 2}, {1, 0, 2}, {1, 2, 0}, {2, 1, 0}, {2, 0, 1}, {0, 2, 1}};
+
+/*********************************************************************
+ * @fn      calc_pwm_svm
+ *
+ * @brief   Space vector modulation kernel in Q15 fixed point (no division in the linear range).
+ *          Finds the sector of the reference vector, the dwell times T1, T2 of its two neighbouring
+ *          active vectors and T0 of the zero vectors, and centers the active vectors in the period
+ *          (T0 split evenly between 000 and 111). Vectors beyond the hexagon are scaled back onto it.
+ *          The reference is normalized to Vdc / sqrt(3), so PWM_SVM_ONE is the largest undistorted
+ *          amplitude, 15% above the limit of sine PWM.
+ * 
+ * @param   alpha       Alpha component of reference vector (Q15, PWM_SVM_ONE = Vdc / sqrt(3), -65535 - 65535)
+ * @param   beta        Beta component of reference vector (Q15, -65535 - 65535)
+ * @param   duty        Destination for duty cycles of phase A, B and C (Q15, 32768 = always on)
+ * @param   dwell       Destination for T1, T2 and T0 (Q15 of period, NULL = not needed)
+ *
+ * @return  Sector (1 - 6)
+ */
+uint8_t calc_pwm_svm(int32_t alpha, int32_t beta, uint16_t duty[3], uint16_t dwell[3])
+{
+    // ---------- Sector ----------
+    int32_t w = (PWM_SVM_SQRT3_2 * alpha - 16384 * beta) >> 15;     // |v| * sin(60 - theta)
+    int32_t y = (PWM_SVM_SQRT3_2 * alpha + 16384 * beta) >> 15;     // |v| * sin(60 + theta)
+    uint8_t sector = pwm_svm_sectors[((beta > 0) << 2) | ((w > 0) << 1) | (y > 0)];
+
+    // ---------- Dwell times of active vectors ----------
+    int32_t t1, t2;
+    switch (sector)
+    {
+        case 1: t1 = w; t2 = beta; break;
+        case 2: t1 = y; t2 = -w; break;
+        case 3: t1 = beta; t2 = -y; break;
+        case 4: t1 = -w; t2 = -beta; break;
+        case 5: t1 = -y; t2 = w; break;
+        default: t1 = -beta; t2 = y; break;
+    }
+    if (t1 < 0) t1 = 0;
+    if (t2 < 0) t2 = 0;
+    if (t1 + t2 > 32768)
+    {
+        // Overmodulation, keep angle and limit to hexagon
+        t1 = (int32_t)(((uint32_t)t1 << 15) / (uint32_t)(t1 + t2));
+        t2 = 32768 - t1;
+    }
+    int32_t t0 = 32768 - t1 - t2;
+
+    // ---------- Center-aligned on times ----------
+    const uint8_t *order = pwm_svm_order[sector];
+    uint16_t low = (uint16_t)(t0 >> 1);
+    duty[order[0]] = (uint16_t)(low + t1 + t2);
+    duty[order[1]] = (uint16_t)(low + ((sector & 1) ? t2 : t1));
+    duty[order[2]] = low;
+    if (dwell)
+    {
+        dwell[0] = (uint16_t)t1;
+        dwell[1] = (uint16_t)t2;
+        dwell[2] = (uint16_t)t0;
+    }
+    return sector;
+}
+
+/*********************************************************************
+ * @fn      init_pwm_svm
+ *
+ * @brief   Initialize a space vector modulator on a group of three channels (phase A, B, C),
+ *          e.g. TIM1 CH1 - CH3 with complementary outputs. An edge-aligned timer is switched to
+ *          center-aligned counting (see set_pwm_counter_mode()), keeping its frequency.
+ *          Compare register preload is enabled and the outputs start at 50% duty cycle (zero vector).
+ * 
+ * @param   svm         Pointer to PWM_svm struct to initialize
+ * @param   group       Pointer to initialized PWM_group struct of three channels, has to stay valid
+ *
+ * @return  PWM_OK on success, PWM_ERR_RANGE if the group has not three channels,
+ *          PWM_ERR_FREQ if the frequency is not reachable in center-aligned mode
+ */
+int init_pwm_svm(PWM_svm *svm, PWM_group *group)
+{
+    if (group == NULL || group->tim == NULL || group->count != 3) return PWM_ERR_RANGE;
+    if (!(group->tim->CTLR1 & TIM_CMS))
+    {
+        int ret = set_pwm_counter_mode(group->timer, PWM_COUNT_CENTER1, PWM_UPDATE_BOTH);
+        if (ret != PWM_OK) return ret;
+    }
+    svm->group = group;
+    for (uint8_t i = 0; i < 3; i++) set_pwm_preload(group->channels[i], ENABLE);
+    set_pwm_svm(svm, 0, 0);
+    return PWM_OK;
+}
+
+/*********************************************************************
+ * @fn      set_pwm_svm
+ *
+ * @brief   Apply a reference vector in stationary coordinates (e.g. output of an inverse Park
+ *          transform). The three compare registers are written with update events disabled,
+ *          so they become active together at the next update event (is_pwm_update_pending() of the
+ *          channels reports when). Fast enough to be called from the update interrupt at every
+ *          switching period.
+ * 
+ * @param   svm         Pointer to initialized PWM_svm struct
+ * @param   alpha       Alpha component of reference vector (Q15, PWM_SVM_ONE = Vdc / sqrt(3), -65535 - 65535)
+ * @param   beta        Beta component of reference vector (Q15, -65535 - 65535)
+ *
+ * @return  None
+ */
+void set_pwm_svm(PWM_svm *svm, int32_t alpha, int32_t beta)
+{
+    uint16_t duty[3];
+    uint16_t dwell[3];
+    PWM_group *group = svm->group;
+    TIM_TypeDef *tim = group->tim;
+    svm->sector = calc_pwm_svm(alpha, beta, duty, dwell);
+    svm->t1 = dwell[0];
+    svm->t2 = dwell[1];
+    svm->t0 = dwell[2];
+    uint32_t len = (uint32_t)group->channels[0]->arr + 1;      // Counts per half period of center-aligned timer
+    tim->CTLR1 |= TIM_UDIS;
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        set_pwm_compare(group->channels[i], (uint16_t)(len - (((uint32_t)duty[i] * len + 0x4000) >> 15)));
+    }
+    tim->CTLR1 &= (uint16_t)~TIM_UDIS;
+}
+
+/*********************************************************************
+ * @fn      set_pwm_svm_polar
+ *
+ * @brief   Apply a reference vector given by magnitude and angle (sine/cosine from the sine table
+ *          of ch32v_pwm_spwm.h)
+ * 
+ * @param   svm         Pointer to initialized PWM_svm struct
+ * @param   magnitude   Magnitude of reference vector (Q15, PWM_SVM_ONE = Vdc / sqrt(3), larger values saturate)
+ * @param   angle       Angle as fraction of a full turn (0x100000000 = 360 degrees)
+ *
+ * @return  None
+ */
+void set_pwm_svm_polar(PWM_svm *svm, uint16_t magnitude, uint32_t angle)
+{
+    int32_t alpha = ((int32_t)magnitude * get_pwm_sine(angle + 0x40000000UL)) >> PWM_SINE_LUT_Q;
+    int32_t beta = ((int32_t)magnitude * get_pwm_sine(angle)) >> PWM_SINE_LUT_Q;
+    set_pwm_svm(svm, alpha, beta);
+}
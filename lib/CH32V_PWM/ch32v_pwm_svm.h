@@ -0,0 +1,65 @@
+/**
+ *  CH32VX PWM Library
+ *
+ *  Copyright (c) 2024 Florian Korotschenko aka KingKoro
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ *
+ *
+ *  file         : ch32v_pwm_svm.h
+ *  description  : ch32v pwm library space vector modulation (SVM) header
+ *
+ */
+
+#ifndef __CH32V_PWM_SVM_H
+#define __CH32V_PWM_SVM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "ch32v_pwm_spwm.h"
+
+// Reference voltage of full linear modulation (Q15), amplitude of Vdc / sqrt(3)
+#define PWM_SVM_ONE     32768
+
+// State of a space vector modulator driving three neighbouring channels (phase A, B, C)
+typedef struct
+{
+    PWM_group *group;       // Three channels of one timer (e.g. TIM1 CH1 - CH3)
+    uint8_t sector;         // Sector of last reference vector (1 - 6)
+    uint16_t t1;            // Dwell time of first active vector (Q15 of period)
+    uint16_t t2;            // Dwell time of second active vector (Q15 of period)
+    uint16_t t0;            // Dwell time of zero vectors (Q15 of period, split between 000 and 111)
+} PWM_svm;
+
+// Calculate sector and phase duty cycles (Q15) of a reference vector, returns the sector (1 - 6)
+extern uint8_t calc_pwm_svm(int32_t alpha, int32_t beta, uint16_t duty[3], uint16_t dwell[3]);
+// Function to initialize a space vector modulator, switches the timer to center-aligned counting
+extern int init_pwm_svm(PWM_svm *svm, PWM_group *group);
+// Function to apply a reference vector in stationary (alpha, beta) coordinates
+extern void set_pwm_svm(PWM_svm *svm, int32_t alpha, int32_t beta);
+// Function to apply a reference vector given by magnitude and angle
+extern void set_pwm_svm_polar(PWM_svm *svm, uint16_t magnitude, uint32_t angle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
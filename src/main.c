@@ -40,20 +40,90 @@
 
 #include "ch32v_usb_serial.h"
 #include "ch32v_pwm.h"
+#include "ch32v_pwm_svm.h"
 
 #define TRUE 1
 #define FALSE 0
 
+// Uncomment to print the cycles per call of the duty cycle paths on the serial console at startup
+//#define PWM_BENCHMARK
+#define PWM_BENCHMARK_CALLS 1000
+
 
 /*
 This example program provides a PWM output on 3 pins of the CH32V203C8T6-EVT-R0 (PA8, PA6, PB8).
 Additonally, it periodically prints out the current duty cycle of PA8 via USBD serial port
 and by typing '+' or '-' into the serial console, the duty cycle of PA8 can be increased or reduced accordingly (8-Bit resolution).
 Note:
-    - The actual PWM frequency might differ from the specified frequency due to rough integer divison.
+    - The actual PWM frequency is stored in PWM_handle.f_actual, its deviation from the specified frequency in PWM_handle.f_error_ppm.
     - The last two arguments (iCount, iPwm_mode) of init_pwm() are optional
 */
 
+#ifdef PWM_BENCHMARK
+/*********************************************************************
+ * @fn      set_pwm_dutycycle_spl
+ *
+ * @brief   Duty cycle update of library version 0.1.3 for TIM1 CH1, as reference for the benchmark:
+ *          the channel is re-initialized through the SPL on every call
+ *
+ * @param   object      Pointer to PWM_handle struct of TIM1 CH1
+ * @param   duty        Duty cycle (0 - period + 1)
+ *
+ * @return  None
+ */
+static void set_pwm_dutycycle_spl(PWM_handle *object, uint16_t duty)
+{
+    TIM_OCInitTypeDef TIM_OCInitStructure={0};
+    TIM_OCInitStructure.TIM_OCMode = (object->pwm_mode == PWM_MODE1) ? TIM_OCMode_PWM1 : TIM_OCMode_PWM2;
+    object->duty_cycle = (duty > object->period + 1) ? object->period + 1 : duty;
+    object->duty_cycle = -(object->duty_cycle - (object->period + 1));
+    TIM_OCInitStructure.TIM_OutputState = TIM_OutputState_Enable;
+    TIM_OCInitStructure.TIM_Pulse = object->duty_cycle;
+    TIM_OCInitStructure.TIM_OCPolarity = TIM_OCPolarity_High;
+    TIM_OC1Init(TIM1, &TIM_OCInitStructure);
+    TIM_CtrlPWMOutputs(TIM1, ENABLE);
+    TIM_OC1PreloadConfig(TIM1, TIM_OCPreload_Disable);
+    TIM_ARRPreloadConfig(TIM1, ENABLE);
+}
+
+/*********************************************************************
+ * @fn      run_pwm_benchmark
+ *
+ * @brief   Measure cycles per call of duty cycle updates and of the SVM kernel with SysTick
+ *          counting HCLK, averaged over PWM_BENCHMARK_CALLS calls (loop overhead included)
+ *
+ * @param   object      Pointer to initialized PWM_handle struct of TIM1 CH1
+ *
+ * @return  None
+ */
+static void run_pwm_benchmark(PWM_handle *object)
+{
+    uint32_t ctlr = SysTick->CTLR;
+    uint64_t start;
+    uint32_t cycles[4];
+    uint16_t duty[3];
+    SysTick->CTLR = (1 << 2) | (1 << 0);                        // Count up at HCLK
+    __disable_irq();
+    start = SysTick->CNT;
+    for (uint16_t i = 0; i < PWM_BENCHMARK_CALLS; i++) set_pwm_dutycycle_spl(object, i & 0xFF);
+    cycles[0] = (uint32_t)(SysTick->CNT - start);
+    start = SysTick->CNT;
+    for (uint16_t i = 0; i < PWM_BENCHMARK_CALLS; i++) set_pwm_dutycycle(object, i & 0xFF);
+    cycles[1] = (uint32_t)(SysTick->CNT - start);
+    start = SysTick->CNT;
+    for (uint16_t i = 0; i < PWM_BENCHMARK_CALLS; i++) set_pwm_dutycycle_q16(object, (uint32_t)i << 6);
+    cycles[2] = (uint32_t)(SysTick->CNT - start);
+    start = SysTick->CNT;
+    for (uint16_t i = 0; i < PWM_BENCHMARK_CALLS; i++) calc_pwm_svm(30000 - 60 * i, 20 * i, duty, NULL);
+    cycles[3] = (uint32_t)(SysTick->CNT - start);
+    __enable_irq();
+    SysTick->CTLR = ctlr;                                       // Delay_Us() expects HCLK / 8
+    printf("Cycles per call: SPL re-init %lu, set_pwm_dutycycle %lu, set_pwm_dutycycle_q16 %lu\r\n",
+           (unsigned long)(cycles[0] / PWM_BENCHMARK_CALLS), (unsigned long)(cycles[1] / PWM_BENCHMARK_CALLS), (unsigned long)(cycles[2] / PWM_BENCHMARK_CALLS));
+    printf("Cycles per call: calc_pwm_svm %lu\r\n", (unsigned long)(cycles[3] / PWM_BENCHMARK_CALLS));
+}
+#endif
+
 int main(void)
 {
     // ---------- Initialization Code ----------
@@ -61,6 +131,9 @@ int main(void)
     SystemCoreClockUpdate();
     Delay_Init();
 
+    // TIM2 is used by USB_Serial_initialize() for its tick, keep it away from PWM
+    reserve_pwm_timer(PWM_TIM2);
+
     // Initialize PWM on PA8 (TIM1_CH1) with 10kHz Base frequency
     PWM_handle PWM_A8={0};
     init_pwm(&PWM_A8, PWM_TIM1, PWM_CH1, 0x0A08, 10000);
@@ -82,6 +155,10 @@ int main(void)
     // Comment out if PA9/PA10 wanted as PWM Output
     USART_Printf_Init(115200);
     printf("CH32V203_EVT PWM Demo - Starting ...\r\n");
+#ifdef PWM_BENCHMARK
+    run_pwm_benchmark(&PWM_A8);
+    set_pwm_dutycycle(&PWM_A8, 191);
+#endif
 
     // Setup Code USB Serial
     USB_Serial_initialize();
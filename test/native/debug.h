@@ -0,0 +1,292 @@
+/**
+ *  Host stand-in for the parts of the WCH NoneOS SDK used by the CH32VX PWM Library.
+ *  Peripherals are plain structs in RAM, SPL functions only mirror their register writes,
+ *  so the register-free parts of the library (solver, SVM kernel, DMA frame generators)
+ *  can be unit tested on the host with "pio test -e native".
+ *  Flag registers are ordinary memory here: writing ~flag sets all other flags, unlike
+ *  the rc_w0 hardware registers.
+ */
+#ifndef STUB_DEBUG_H
+#define STUB_DEBUG_H
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#define __IO volatile
+typedef enum {DISABLE = 0, ENABLE = !DISABLE} FunctionalState;
+typedef enum {RESET = 0, SET = !RESET} FlagStatus, ITStatus;
+extern uint32_t SystemCoreClock;
+typedef struct {
+    __IO uint16_t CTLR1; uint16_t R0; __IO uint16_t CTLR2; uint16_t R1; __IO uint16_t SMCFGR; uint16_t R2;
+    __IO uint16_t DMAINTENR; uint16_t R3; __IO uint16_t INTFR; uint16_t R4; __IO uint16_t SWEVGR; uint16_t R5;
+    __IO uint16_t CHCTLR1; uint16_t R6; __IO uint16_t CHCTLR2; uint16_t R7; __IO uint16_t CCER; uint16_t R8;
+    __IO uint16_t CNT; uint16_t R9; __IO uint16_t PSC; uint16_t R10; __IO uint16_t ATRLR; uint16_t R11;
+    __IO uint16_t RPTCR; uint16_t R12; __IO uint16_t CH1CVR; uint16_t R13; __IO uint16_t CH2CVR; uint16_t R14;
+    __IO uint16_t CH3CVR; uint16_t R15; __IO uint16_t CH4CVR; uint16_t R16; __IO uint16_t BDTR; uint16_t R17;
+    __IO uint16_t DMACFGR; uint16_t R18; __IO uint16_t DMAADR; uint16_t R19;
+} TIM_TypeDef;
+typedef struct { __IO uint32_t CFGLR, CFGHR, INDR, OUTDR, BSHR, BCR, LCKR; } GPIO_TypeDef;
+typedef struct { __IO uint32_t CFGR, CNTR, PADDR, MADDR; } DMA_Channel_TypeDef;
+typedef struct { __IO uint32_t INTFR, INTFCR; } DMA_TypeDef;
+typedef struct { __IO uint32_t ECR, PCFR1, EXTICR[4], RESERVED0, PCFR2; } AFIO_TypeDef;
+extern TIM_TypeDef stub_tim[5]; extern GPIO_TypeDef stub_gpio[4];
+extern DMA_Channel_TypeDef stub_dma_ch[8]; extern DMA_TypeDef stub_dma1; extern AFIO_TypeDef stub_afio;
+#define TIM1 (&stub_tim[1])
+#define TIM2 (&stub_tim[2])
+#define TIM3 (&stub_tim[3])
+#define TIM4 (&stub_tim[4])
+#define GPIOA (&stub_gpio[0])
+#define GPIOB (&stub_gpio[1])
+#define GPIOC (&stub_gpio[2])
+#define GPIOD (&stub_gpio[3])
+#define AFIO (&stub_afio)
+#define TIM1_BASE ((uint32_t)0x40012C00)
+#define TIM2_BASE ((uint32_t)0x40000000)
+#define TIM3_BASE ((uint32_t)0x40000400)
+#define TIM4_BASE ((uint32_t)0x40000800)
+#define DMA1 (&stub_dma1)
+#define DMA1_Channel1 (&stub_dma_ch[1])
+#define DMA1_Channel2 (&stub_dma_ch[2])
+#define DMA1_Channel3 (&stub_dma_ch[3])
+#define DMA1_Channel4 (&stub_dma_ch[4])
+#define DMA1_Channel5 (&stub_dma_ch[5])
+#define DMA1_Channel6 (&stub_dma_ch[6])
+#define DMA1_Channel7 (&stub_dma_ch[7])
+/* bits */
+#define TIM_CEN 0x0001
+#define TIM_UDIS 0x0002
+#define TIM_URS 0x0004
+#define TIM_OPM 0x0008
+#define TIM_DIR 0x0010
+#define TIM_CMS 0x0060
+#define TIM_CMS_0 0x0020
+#define TIM_CMS_1 0x0040
+#define TIM_ARPE 0x0080
+#define TIM_MMS 0x0070
+#define TIM_SMS 0x0007
+#define TIM_TS 0x0070
+#define TIM_MSM 0x0080
+#define TIM_UIE 0x0001
+#define TIM_CC1IE 0x0002
+#define TIM_CC2IE 0x0004
+#define TIM_BIE 0x0080
+#define TIM_UDE 0x0100
+#define TIM_UIF 0x0001
+#define TIM_CC1IF 0x0002
+#define TIM_CC2IF 0x0004
+#define TIM_BIF 0x0080
+#define TIM_CC1OF 0x0200
+#define TIM_CC2OF 0x0400
+#define TIM_UG 0x0001
+#define TIM_OC1PE 0x0008
+#define TIM_OC2PE 0x0800
+#define TIM_OC3PE 0x0008
+#define TIM_OC4PE 0x0800
+#define TIM_CC1E 0x0001
+#define TIM_CC2E 0x0010
+#define TIM_CC1P 0x0002
+#define TIM_CC1NE 0x0004
+#define TIM_CC1NP 0x0008
+#define TIM_DTG 0x00FF
+#define TIM_OSSI 0x0400
+#define TIM_OSSR 0x0800
+#define TIM_BKE 0x1000
+#define TIM_BKP 0x2000
+#define TIM_AOE 0x4000
+#define TIM_MOE 0x8000
+#define TIM_DBA 0x001F
+#define TIM_DBL 0x1F00
+/* SPL */
+typedef uint8_t GPIOMode_TypeDef;
+typedef struct { uint16_t GPIO_Pin; uint8_t GPIO_Speed; GPIOMode_TypeDef GPIO_Mode; } GPIO_InitTypeDef;
+#define GPIO_Pin_0 ((uint16_t)0x0001)
+#define GPIO_Mode_AF_PP 0x18
+#define GPIO_Mode_IN_FLOATING 0x04
+#define GPIO_Mode_IPU 0x48
+#define GPIO_Speed_50MHz 3
+void GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *s);
+void GPIO_PinRemapConfig(uint32_t GPIO_Remap, FunctionalState NewState);
+#define GPIO_PartialRemap_TIM1 0x00160040
+#define GPIO_FullRemap_TIM1 0x001600C0
+#define GPIO_PartialRemap1_TIM2 0x00180100
+#define GPIO_PartialRemap2_TIM2 0x00180200
+#define GPIO_FullRemap_TIM2 0x00180300
+#define GPIO_PartialRemap_TIM3 0x001A0800
+#define GPIO_FullRemap_TIM3 0x001A0C00
+#define GPIO_Remap_TIM4 0x00001000
+#define RCC_APB2Periph_AFIO 0x01
+#define RCC_APB2Periph_GPIOA 0x04
+#define RCC_APB2Periph_GPIOB 0x08
+#define RCC_APB2Periph_GPIOC 0x10
+#define RCC_APB2Periph_GPIOD 0x20
+#define RCC_APB2Periph_TIM1 0x800
+#define RCC_APB1Periph_TIM2 0x01
+#define RCC_APB1Periph_TIM3 0x02
+#define RCC_APB1Periph_TIM4 0x04
+#define RCC_AHBPeriph_DMA1 0x01
+void RCC_APB2PeriphClockCmd(uint32_t p, FunctionalState s);
+void RCC_APB1PeriphClockCmd(uint32_t p, FunctionalState s);
+void RCC_AHBPeriphClockCmd(uint32_t p, FunctionalState s);
+typedef struct { uint16_t TIM_Prescaler; uint16_t TIM_CounterMode; uint16_t TIM_Period; uint16_t TIM_ClockDivision; uint8_t TIM_RepetitionCounter; } TIM_TimeBaseInitTypeDef;
+typedef struct { uint16_t TIM_OCMode, TIM_OutputState, TIM_OutputNState, TIM_Pulse, TIM_OCPolarity, TIM_OCNPolarity, TIM_OCIdleState, TIM_OCNIdleState; } TIM_OCInitTypeDef;
+typedef struct { uint16_t TIM_Channel, TIM_ICPolarity, TIM_ICSelection, TIM_ICPrescaler, TIM_ICFilter; } TIM_ICInitTypeDef;
+typedef struct { uint16_t TIM_OSSRState, TIM_OSSIState, TIM_LOCKLevel, TIM_DeadTime, TIM_Break, TIM_BreakPolarity, TIM_AutomaticOutput; } TIM_BDTRInitTypeDef;
+#define TIM_CKD_DIV1 0x0000
+#define TIM_CounterMode_Up 0x0000
+#define TIM_CounterMode_Down 0x0010
+#define TIM_CounterMode_CenterAligned1 0x0020
+#define TIM_CounterMode_CenterAligned2 0x0040
+#define TIM_CounterMode_CenterAligned3 0x0060
+#define TIM_OCMode_Timing 0x0000
+#define TIM_OCMode_Active 0x0010
+#define TIM_OCMode_Inactive 0x0020
+#define TIM_OCMode_PWM1 0x0060
+#define TIM_OCMode_PWM2 0x0070
+#define TIM_OutputState_Disable 0x0000
+#define TIM_OutputState_Enable 0x0001
+#define TIM_OutputNState_Disable 0x0000
+#define TIM_OutputNState_Enable 0x0004
+#define TIM_OCPolarity_High 0x0000
+#define TIM_OCPolarity_Low 0x0002
+#define TIM_OCNPolarity_High 0x0000
+#define TIM_OCNPolarity_Low 0x0008
+#define TIM_OCIdleState_Set 0x0100
+#define TIM_OCIdleState_Reset 0x0000
+#define TIM_OCNIdleState_Set 0x0200
+#define TIM_OCNIdleState_Reset 0x0000
+#define TIM_OCPreload_Enable 0x0008
+#define TIM_OCPreload_Disable 0x0000
+#define TIM_TRGOSource_Reset 0x0000
+#define TIM_TRGOSource_Enable 0x0010
+#define TIM_TRGOSource_Update 0x0020
+#define TIM_SlaveMode_Reset 0x0004
+#define TIM_SlaveMode_Gated 0x0005
+#define TIM_SlaveMode_Trigger 0x0006
+#define TIM_SlaveMode_External1 0x0007
+#define TIM_MasterSlaveMode_Enable 0x0080
+#define TIM_MasterSlaveMode_Disable 0x0000
+#define TIM_TS_ITR0 0x0000
+#define TIM_TS_ITR1 0x0010
+#define TIM_TS_ITR2 0x0020
+#define TIM_TS_ITR3 0x0030
+#define TIM_TS_TI1FP1 0x0050
+#define TIM_TS_TI2FP2 0x0060
+#define TIM_IT_Update 0x0001
+#define TIM_IT_CC1 0x0002
+#define TIM_IT_CC2 0x0004
+#define TIM_IT_CC3 0x0008
+#define TIM_IT_CC4 0x0010
+#define TIM_IT_Break 0x0080
+#define TIM_FLAG_Update 0x0001
+#define TIM_FLAG_Break 0x0080
+#define TIM_EventSource_Update 0x0001
+#define TIM_DMA_Update 0x0100
+#define TIM_DMA_CC1 0x0200
+#define TIM_DMABase_CCR1 0x000D
+#define TIM_DMABase_ARR 0x000B
+#define TIM_DMABurstLength_1Transfer 0x0000
+#define TIM_DMABurstLength_2Transfers 0x0100
+#define TIM_DMABurstLength_3Transfers 0x0200
+#define TIM_DMABurstLength_4Transfers 0x0300
+#define TIM_Channel_1 0x0000
+#define TIM_Channel_2 0x0004
+#define TIM_Channel_3 0x0008
+#define TIM_Channel_4 0x000C
+#define TIM_ICPolarity_Rising 0x0000
+#define TIM_ICPolarity_Falling 0x0002
+#define TIM_ICSelection_DirectTI 0x0001
+#define TIM_ICSelection_IndirectTI 0x0002
+#define TIM_ICPSC_DIV1 0x0000
+#define TIM_OPMode_Single 0x0008
+#define TIM_OPMode_Repetitive 0x0000
+#define TIM_PSCReloadMode_Update 0x0000
+#define TIM_PSCReloadMode_Immediate 0x0001
+#define TIM_OSSRState_Enable 0x0800
+#define TIM_OSSRState_Disable 0x0000
+#define TIM_OSSIState_Enable 0x0400
+#define TIM_OSSIState_Disable 0x0000
+#define TIM_LOCKLevel_OFF 0x0000
+#define TIM_Break_Enable 0x1000
+#define TIM_Break_Disable 0x0000
+#define TIM_BreakPolarity_Low 0x0000
+#define TIM_BreakPolarity_High 0x2000
+#define TIM_AutomaticOutput_Enable 0x4000
+#define TIM_AutomaticOutput_Disable 0x0000
+void TIM_DeInit(TIM_TypeDef*);
+void TIM_TimeBaseInit(TIM_TypeDef*, TIM_TimeBaseInitTypeDef*);
+void TIM_OC1Init(TIM_TypeDef*, TIM_OCInitTypeDef*);
+void TIM_OC2Init(TIM_TypeDef*, TIM_OCInitTypeDef*);
+void TIM_OC3Init(TIM_TypeDef*, TIM_OCInitTypeDef*);
+void TIM_OC4Init(TIM_TypeDef*, TIM_OCInitTypeDef*);
+void TIM_ICInit(TIM_TypeDef*, TIM_ICInitTypeDef*);
+void TIM_PWMIConfig(TIM_TypeDef*, TIM_ICInitTypeDef*);
+void TIM_BDTRConfig(TIM_TypeDef*, TIM_BDTRInitTypeDef*);
+void TIM_Cmd(TIM_TypeDef*, FunctionalState);
+void TIM_CtrlPWMOutputs(TIM_TypeDef*, FunctionalState);
+void TIM_ITConfig(TIM_TypeDef*, uint16_t, FunctionalState);
+void TIM_GenerateEvent(TIM_TypeDef*, uint16_t);
+void TIM_DMAConfig(TIM_TypeDef*, uint16_t, uint16_t);
+void TIM_DMACmd(TIM_TypeDef*, uint16_t, FunctionalState);
+void TIM_SelectInputTrigger(TIM_TypeDef*, uint16_t);
+void TIM_SelectOutputTrigger(TIM_TypeDef*, uint16_t);
+void TIM_SelectSlaveMode(TIM_TypeDef*, uint16_t);
+void TIM_SelectMasterSlaveMode(TIM_TypeDef*, uint16_t);
+void TIM_SelectOnePulseMode(TIM_TypeDef*, uint16_t);
+void TIM_UpdateDisableConfig(TIM_TypeDef*, FunctionalState);
+void TIM_ARRPreloadConfig(TIM_TypeDef*, FunctionalState);
+void TIM_OC1PreloadConfig(TIM_TypeDef*, uint16_t);
+void TIM_OC2PreloadConfig(TIM_TypeDef*, uint16_t);
+void TIM_OC3PreloadConfig(TIM_TypeDef*, uint16_t);
+void TIM_OC4PreloadConfig(TIM_TypeDef*, uint16_t);
+void TIM_SetCounter(TIM_TypeDef*, uint16_t);
+void TIM_SetAutoreload(TIM_TypeDef*, uint16_t);
+void TIM_PrescalerConfig(TIM_TypeDef*, uint16_t, uint16_t);
+void TIM_ClearFlag(TIM_TypeDef*, uint16_t);
+void TIM_ClearITPendingBit(TIM_TypeDef*, uint16_t);
+ITStatus TIM_GetITStatus(TIM_TypeDef*, uint16_t);
+FlagStatus TIM_GetFlagStatus(TIM_TypeDef*, uint16_t);
+void TIM_CCxCmd(TIM_TypeDef*, uint16_t, uint16_t);
+void TIM_CCxNCmd(TIM_TypeDef*, uint16_t, uint16_t);
+void TIM_ETRClockMode1Config(TIM_TypeDef*, uint16_t, uint16_t, uint16_t);
+void TIM_ITRxExternalClockConfig(TIM_TypeDef*, uint16_t);
+uint16_t TIM_GetCapture1(TIM_TypeDef*);
+uint16_t TIM_GetCapture2(TIM_TypeDef*);
+/* DMA */
+typedef struct { uint32_t DMA_PeripheralBaseAddr, DMA_MemoryBaseAddr, DMA_DIR, DMA_BufferSize, DMA_PeripheralInc, DMA_MemoryInc, DMA_PeripheralDataSize, DMA_MemoryDataSize, DMA_Mode, DMA_Priority, DMA_M2M; } DMA_InitTypeDef;
+#define DMA_DIR_PeripheralDST 0x10
+#define DMA_DIR_PeripheralSRC 0x00
+#define DMA_PeripheralInc_Disable 0
+#define DMA_MemoryInc_Enable 0x80
+#define DMA_MemoryInc_Disable 0
+#define DMA_PeripheralDataSize_HalfWord 0x100
+#define DMA_MemoryDataSize_HalfWord 0x400
+#define DMA_Mode_Circular 0x20
+#define DMA_Mode_Normal 0
+#define DMA_Priority_High 0x2000
+#define DMA_Priority_VeryHigh 0x3000
+#define DMA_M2M_Disable 0
+#define DMA_IT_TC 0x02
+#define DMA_IT_HT 0x04
+#define DMA_IT_TE 0x08
+#define DMA_CFGR1_EN 0x1
+#define DMA_CFGR1_CIRC 0x20
+#define DMA1_FLAG_GL1 0x1
+#define DMA1_FLAG_TC1 0x2
+#define DMA1_FLAG_HT1 0x4
+#define DMA1_FLAG_TE1 0x8
+void DMA_DeInit(DMA_Channel_TypeDef*);
+void DMA_Init(DMA_Channel_TypeDef*, DMA_InitTypeDef*);
+void DMA_Cmd(DMA_Channel_TypeDef*, FunctionalState);
+void DMA_ITConfig(DMA_Channel_TypeDef*, uint32_t, FunctionalState);
+uint16_t DMA_GetCurrDataCounter(DMA_Channel_TypeDef*);
+/* NVIC */
+typedef enum { TIM1_BRK_IRQn=40, TIM1_UP_IRQn, TIM1_TRG_COM_IRQn, TIM1_CC_IRQn, TIM2_IRQn, TIM3_IRQn, TIM4_IRQn, TIM2_UP_IRQn=60, TIM2_CC_IRQn, TIM2_BRK_IRQn,
+  DMA1_Channel1_IRQn=27, DMA1_Channel2_IRQn, DMA1_Channel3_IRQn, DMA1_Channel4_IRQn, DMA1_Channel5_IRQn, DMA1_Channel6_IRQn, DMA1_Channel7_IRQn } IRQn_Type;
+void NVIC_EnableIRQ(IRQn_Type);
+void NVIC_DisableIRQ(IRQn_Type);
+void __disable_irq(void);
+void __enable_irq(void);
+typedef struct { __IO uint32_t CTLR, SR; __IO uint64_t CNT; __IO uint64_t CMP; } SysTick_Type;
+extern SysTick_Type stub_systick;
+#define SysTick (&stub_systick)
+void Delay_Us(uint32_t);
+#endif
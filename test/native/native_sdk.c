@@ -0,0 +1,59 @@
+/**
+ *  Host stand-in for the WCH NoneOS SDK, register model and SPL functions (see debug.h).
+ *  Included once by every native test suite.
+ */
+#include "debug.h"
+uint32_t SystemCoreClock = 144000000;
+TIM_TypeDef stub_tim[5]; GPIO_TypeDef stub_gpio[4]; DMA_Channel_TypeDef stub_dma_ch[8]; DMA_TypeDef stub_dma1; AFIO_TypeDef stub_afio; SysTick_Type stub_systick;
+void GPIO_Init(GPIO_TypeDef *g, GPIO_InitTypeDef *s){(void)g;(void)s;}
+void GPIO_PinRemapConfig(uint32_t r, FunctionalState s){(void)r;(void)s;}
+void RCC_APB2PeriphClockCmd(uint32_t p, FunctionalState s){(void)p;(void)s;}
+void RCC_APB1PeriphClockCmd(uint32_t p, FunctionalState s){(void)p;(void)s;}
+void RCC_AHBPeriphClockCmd(uint32_t p, FunctionalState s){(void)p;(void)s;}
+void TIM_DeInit(TIM_TypeDef*t){(void)t;}
+void TIM_TimeBaseInit(TIM_TypeDef*t, TIM_TimeBaseInitTypeDef*s){t->PSC=s->TIM_Prescaler;t->ATRLR=s->TIM_Period;t->CTLR1=(t->CTLR1&~0x70)|s->TIM_CounterMode;t->RPTCR=s->TIM_RepetitionCounter;}
+#define OCI(n,reg,sh,cc) void TIM_OC##n##Init(TIM_TypeDef*t, TIM_OCInitTypeDef*s){t->reg=(t->reg&~(0xff<<sh))|(s->TIM_OCMode<<sh);t->CH##n##CVR=s->TIM_Pulse;t->CCER=(t->CCER&~(0xf<<cc))|((s->TIM_OutputState|s->TIM_OCPolarity|s->TIM_OutputNState|s->TIM_OCNPolarity)<<cc);}
+OCI(1,CHCTLR1,0,0) OCI(2,CHCTLR1,8,4) OCI(3,CHCTLR2,0,8) OCI(4,CHCTLR2,8,12)
+void TIM_ICInit(TIM_TypeDef*t, TIM_ICInitTypeDef*s){(void)t;(void)s;}
+void TIM_PWMIConfig(TIM_TypeDef*t, TIM_ICInitTypeDef*s){(void)t;(void)s;}
+void TIM_BDTRConfig(TIM_TypeDef*t, TIM_BDTRInitTypeDef*s){t->BDTR=s->TIM_OSSRState|s->TIM_OSSIState|s->TIM_LOCKLevel|s->TIM_DeadTime|s->TIM_Break|s->TIM_BreakPolarity|s->TIM_AutomaticOutput;}
+void TIM_Cmd(TIM_TypeDef*t, FunctionalState s){if(s)t->CTLR1|=1;else t->CTLR1&=~1;}
+void TIM_CtrlPWMOutputs(TIM_TypeDef*t, FunctionalState s){if(s)t->BDTR|=0x8000;else t->BDTR&=~0x8000;}
+void TIM_ITConfig(TIM_TypeDef*t, uint16_t i, FunctionalState s){if(s)t->DMAINTENR|=i;else t->DMAINTENR&=~i;}
+void TIM_GenerateEvent(TIM_TypeDef*t, uint16_t e){t->SWEVGR=e;}
+void TIM_DMAConfig(TIM_TypeDef*t, uint16_t b, uint16_t l){t->DMACFGR=b|l;}
+void TIM_DMACmd(TIM_TypeDef*t, uint16_t d, FunctionalState s){if(s)t->DMAINTENR|=d;else t->DMAINTENR&=~d;}
+void TIM_SelectInputTrigger(TIM_TypeDef*t, uint16_t v){t->SMCFGR=(t->SMCFGR&~0x70)|v;}
+void TIM_SelectOutputTrigger(TIM_TypeDef*t, uint16_t v){t->CTLR2=(t->CTLR2&~0x70)|v;}
+void TIM_SelectSlaveMode(TIM_TypeDef*t, uint16_t v){t->SMCFGR=(t->SMCFGR&~7)|v;}
+void TIM_SelectMasterSlaveMode(TIM_TypeDef*t, uint16_t v){t->SMCFGR=(t->SMCFGR&~0x80)|v;}
+void TIM_SelectOnePulseMode(TIM_TypeDef*t, uint16_t v){t->CTLR1=(t->CTLR1&~8)|v;}
+void TIM_UpdateDisableConfig(TIM_TypeDef*t, FunctionalState s){if(s)t->CTLR1|=2;else t->CTLR1&=~2;}
+void TIM_ARRPreloadConfig(TIM_TypeDef*t, FunctionalState s){if(s)t->CTLR1|=0x80;else t->CTLR1&=~0x80;}
+void TIM_OC1PreloadConfig(TIM_TypeDef*t, uint16_t v){t->CHCTLR1=(t->CHCTLR1&~8)|v;}
+void TIM_OC2PreloadConfig(TIM_TypeDef*t, uint16_t v){t->CHCTLR1=(t->CHCTLR1&~0x800)|(v<<8);}
+void TIM_OC3PreloadConfig(TIM_TypeDef*t, uint16_t v){t->CHCTLR2=(t->CHCTLR2&~8)|v;}
+void TIM_OC4PreloadConfig(TIM_TypeDef*t, uint16_t v){t->CHCTLR2=(t->CHCTLR2&~0x800)|(v<<8);}
+void TIM_SetCounter(TIM_TypeDef*t, uint16_t v){t->CNT=v;}
+void TIM_SetAutoreload(TIM_TypeDef*t, uint16_t v){t->ATRLR=v;}
+void TIM_PrescalerConfig(TIM_TypeDef*t, uint16_t v, uint16_t m){t->PSC=v;(void)m;}
+void TIM_ClearFlag(TIM_TypeDef*t, uint16_t f){t->INTFR&=~f;}
+void TIM_ClearITPendingBit(TIM_TypeDef*t, uint16_t f){t->INTFR&=~f;}
+ITStatus TIM_GetITStatus(TIM_TypeDef*t, uint16_t f){return (t->INTFR&f)&&(t->DMAINTENR&f);}
+FlagStatus TIM_GetFlagStatus(TIM_TypeDef*t, uint16_t f){return (t->INTFR&f)!=0;}
+void TIM_CCxCmd(TIM_TypeDef*t, uint16_t c, uint16_t x){t->CCER=(t->CCER&~(1<<c))|(x<<c);}
+void TIM_CCxNCmd(TIM_TypeDef*t, uint16_t c, uint16_t x){t->CCER=(t->CCER&~(4<<c))|(x<<c);}
+void TIM_ETRClockMode1Config(TIM_TypeDef*t, uint16_t a, uint16_t b, uint16_t c){(void)t;(void)a;(void)b;(void)c;}
+void TIM_ITRxExternalClockConfig(TIM_TypeDef*t, uint16_t v){t->SMCFGR=v|7;}
+uint16_t TIM_GetCapture1(TIM_TypeDef*t){return t->CH1CVR;}
+uint16_t TIM_GetCapture2(TIM_TypeDef*t){return t->CH2CVR;}
+void DMA_DeInit(DMA_Channel_TypeDef*d){d->CFGR=0;}
+void DMA_Init(DMA_Channel_TypeDef*d, DMA_InitTypeDef*s){d->PADDR=s->DMA_PeripheralBaseAddr;d->MADDR=s->DMA_MemoryBaseAddr;d->CNTR=s->DMA_BufferSize;d->CFGR=s->DMA_DIR|s->DMA_Mode|s->DMA_MemoryInc|s->DMA_PeripheralDataSize|s->DMA_MemoryDataSize|s->DMA_Priority;}
+void DMA_Cmd(DMA_Channel_TypeDef*d, FunctionalState s){if(s)d->CFGR|=1;else d->CFGR&=~1;}
+void DMA_ITConfig(DMA_Channel_TypeDef*d, uint32_t i, FunctionalState s){if(s)d->CFGR|=i;else d->CFGR&=~i;}
+uint16_t DMA_GetCurrDataCounter(DMA_Channel_TypeDef*d){return d->CNTR;}
+void NVIC_EnableIRQ(IRQn_Type i){(void)i;}
+void NVIC_DisableIRQ(IRQn_Type i){(void)i;}
+void __disable_irq(void){}
+void __enable_irq(void){}
+void Delay_Us(uint32_t u){(void)u;}
@@ -0,0 +1,171 @@
+/**
+ *  CH32VX PWM Library
+ *
+ *  Copyright (c) 2024 Florian Korotschenko aka KingKoro
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ *
+ *
+ *
+ *
+ *  file         : test_main.c
+ *  description  : native tests of the PSC/ARR solver against an exhaustive search
+ *
+ */
+
+#include <unity.h>
+#include "ch32v_pwm.h"
+#include "native_sdk.c"
+
+// Timer clocks of the supported MCU families (CH32X035, CH32V10x, CH32V20x, CH32V30x)
+static const uint32_t clocks[] = { 48000000, 72000000, 96000000, 144000000 };
+// Requested frequencies in Hz, from sub-kHz up to a few counts per period
+static const uint32_t freqs[] = { 1, 3, 7, 50, 100, 440, 1000, 1234, 9999, 20000, 25000, 32768, 40000, 100000, 123457, 250000, 1000000, 3000000 };
+// Minimum ARR values
+static const uint16_t min_counts[] = { 1, 254, 1023, 4095 };
+
+// Best pair of an exhaustive search, error as fraction err / n of the target period
+typedef struct
+{
+    uint32_t p;
+    uint32_t a;
+    uint64_t err;
+    uint64_t n;
+} pair;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+/*********************************************************************
+ * @fn      brute_timebase
+ *
+ * @brief   Reference search over every prescaler p in p_lo .. p_hi. For a fixed p the relative error
+ *          |f_clk - f * p * a| / (p * a) falls towards the ideal a and rises behind it, so checking all a
+ *          reduces to floor and ceil of the ideal a (clamped to a_min .. 65536). Equal errors keep the
+ *          largest a, like the solver.
+ */
+static pair brute_timebase(uint32_t f_clk, uint32_t f, uint32_t a_min, uint32_t p_lo, uint32_t p_hi)
+{
+    pair best = { 0, 0, 0, 1 };
+    for (uint32_t p = p_lo; p <= p_hi; p++)
+    {
+        uint64_t ideal = (uint64_t)f_clk / ((uint64_t)f * p);
+        for (uint64_t a = ideal; a <= ideal + 1; a++)
+        {
+            if (a < a_min || a > 65536) continue;
+            uint64_t n = (uint64_t)p * a;
+            uint64_t fn = (uint64_t)f * n;
+            uint64_t err = (fn > f_clk) ? fn - f_clk : f_clk - fn;
+            if (best.p == 0 || err * best.n < best.err * n || (err * best.n == best.err * n && a > best.a))
+            {
+                best.p = p;
+                best.a = (uint32_t)a;
+                best.err = err;
+                best.n = n;
+            }
+        }
+    }
+    return best;
+}
+
+// Solver matches the exhaustive search wherever its prescaler window is not cut by PWM_SOLVER_MAX_STEPS
+static void test_solver_matches_exhaustive_search(void)
+{
+    char msg[96];
+    for (uint8_t c = 0; c < sizeof(clocks) / sizeof(clocks[0]); c++)
+    {
+        for (uint8_t i = 0; i < sizeof(freqs) / sizeof(freqs[0]); i++)
+        {
+            for (uint8_t m = 0; m < sizeof(min_counts) / sizeof(min_counts[0]); m++)
+            {
+                uint32_t f_clk = clocks[c], f = freqs[i], a_min = (uint32_t)min_counts[m] + 1;
+                snprintf(msg, sizeof(msg), "f_clk %lu f %lu min_count %u", (unsigned long)f_clk, (unsigned long)f, min_counts[m]);
+                PWM_timebase tb;
+                int ret = solve_pwm_timebase(&tb, f_clk, f, min_counts[m]);
+                pair ref = brute_timebase(f_clk, f, a_min, 1, 65536);
+                if (ref.p == 0)
+                {
+                    TEST_ASSERT_EQUAL_INT_MESSAGE(PWM_ERR_FREQ, ret, msg);
+                    continue;
+                }
+                TEST_ASSERT_EQUAL_INT_MESSAGE(PWM_OK, ret, msg);
+                uint64_t n = ((uint64_t)tb.prescaler + 1) * ((uint64_t)tb.arr + 1);
+                uint64_t fn = (uint64_t)f * n;
+                uint64_t err = (fn > f_clk) ? fn - f_clk : f_clk - fn;
+                TEST_ASSERT_TRUE_MESSAGE(tb.arr >= min_counts[m], msg);
+
+                uint64_t n_target = f_clk / f;
+                uint32_t p_lo = (n_target >> 16) ? (uint32_t)(n_target >> 16) : 1;
+                uint64_t p_hi = n_target / a_min + 1;
+                if (p_hi > 65536) p_hi = 65536;
+                if (p_hi - p_lo <= PWM_SOLVER_MAX_STEPS)
+                {
+                    // Full window searched: same pair, same error
+                    TEST_ASSERT_EQUAL_UINT32_MESSAGE(ref.p - 1, tb.prescaler, msg);
+                    TEST_ASSERT_EQUAL_UINT32_MESSAGE(ref.a - 1, tb.arr, msg);
+                    TEST_ASSERT_TRUE_MESSAGE(err * ref.n == ref.err * n, msg);
+                }
+                else
+                {
+                    // Window cut: optimal within the searched prescalers, within 1ppm of the global optimum
+                    pair win = brute_timebase(f_clk, f, a_min, p_lo, p_lo + PWM_SOLVER_MAX_STEPS);
+                    TEST_ASSERT_TRUE_MESSAGE(err * win.n == win.err * n, msg);
+                    TEST_ASSERT_TRUE_MESSAGE(err * 1000000 <= (ref.err * 1000000 / ref.n + 1) * n, msg);
+                }
+
+                // Reported error matches the chosen pair
+                PWM_timebase ev = { tb.prescaler, tb.arr, 0, 0 };
+                eval_pwm_timebase(&ev, f_clk, f);
+                TEST_ASSERT_EQUAL_INT32_MESSAGE(ev.f_error_ppm, tb.f_error_ppm, msg);
+                TEST_ASSERT_EQUAL_UINT32_MESSAGE(ev.f_actual, tb.f_actual, msg);
+            }
+        }
+    }
+}
+
+// Frequencies without enough counts per period are rejected
+static void test_solver_rejects_unreachable(void)
+{
+    PWM_timebase tb;
+    TEST_ASSERT_EQUAL_INT(PWM_ERR_FREQ, solve_pwm_timebase(&tb, 144000000, 0, 254));
+    TEST_ASSERT_EQUAL_INT(PWM_ERR_FREQ, solve_pwm_timebase(&tb, 144000000, 1000000, 254));     // 144 counts < 255
+    TEST_ASSERT_EQUAL_INT(PWM_OK, solve_pwm_timebase(&tb, 144000000, 564705, 254));            // 255 counts
+    TEST_ASSERT_EQUAL_UINT32(254, tb.arr);
+}
+
+// Exact hits are found with zero error
+static void test_solver_exact(void)
+{
+    PWM_timebase tb;
+    TEST_ASSERT_EQUAL_INT(PWM_OK, solve_pwm_timebase(&tb, 144000000, 20000, 254));
+    TEST_ASSERT_EQUAL_UINT32(0, tb.prescaler);
+    TEST_ASSERT_EQUAL_UINT32(7199, tb.arr);
+    TEST_ASSERT_EQUAL_INT(0, tb.f_error_ppm);
+    TEST_ASSERT_EQUAL_INT(PWM_OK, solve_pwm_timebase(&tb, 96000000, 1, 254));
+    TEST_ASSERT_EQUAL_INT(0, tb.f_error_ppm);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_solver_matches_exhaustive_search);
+    RUN_TEST(test_solver_rejects_unreachable);
+    RUN_TEST(test_solver_exact);
+    return UNITY_END();
+}
@@ -0,0 +1,204 @@
+/**
+ *  CH32VX PWM Library
+ *
+ *  Copyright (c) 2024 Florian Korotschenko aka KingKoro
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ *
+ *
+ *
+ *
+ *  file         : test_main.c
+ *  description  : native tests of the spread spectrum frames, checked on the spectrum of the output
+ *
+ */
+
+#include <math.h>
+#include <unity.h>
+#include "ch32v_pwm_dma.h"
+#include "native_sdk.c"
+
+#define SPREAD_PI       3.14159265358979323846
+#define SPREAD_F_BASE   20000               // Carrier in Hz, 7200 counts at 144MHz
+#define SPREAD_DUTY     1800                // 25% duty cycle
+#define SPREAD_FRAMES   512                 // Buffer size in frames
+
+static PWM_handle pwm;
+static PWM_group group;
+static uint16_t buffer[SPREAD_FRAMES * 3];  // {ATRLR, RPTCR, CH1CVR} per frame
+
+void setUp(void)
+{
+    PWM_handle *objects[1] = { &pwm };
+    init_pwm_base(&pwm, PWM_TIM1, PWM_CH1, 0x0A08, SPREAD_F_BASE, 254, PWM_MODE2);
+    set_pwm_dutycycle(&pwm, (uint16_t)((uint32_t)SPREAD_DUTY * (pwm.period + 1) / 7200));
+    init_pwm_group(&group, objects, 1);
+}
+
+void tearDown(void)
+{
+    disable_pwm_spread(&group);
+    disable_pwm_freq_dither(PWM_TIM1);
+    release_pwm(&pwm);
+}
+
+/*********************************************************************
+ * @fn      calc_spread_line
+ *
+ * @brief   Complex amplitude of harmonic k of the output, one profile repetition being the
+ *          fundamental period. The output is high from the compare value to the end of each period
+ *          (PWM mode 2), so every pulse contributes its two edges in closed form.
+ *
+ * @return  Magnitude of the line (1.0 = amplitude of a square wave of full height)
+ */
+static double calc_spread_line(const uint16_t *frames, uint32_t length, uint32_t k)
+{
+    double total = 0;
+    for (uint32_t i = 0; i < length; i++) total += frames[i * 3] + 1;
+    double w = 2 * SPREAD_PI * k / total, re = 0, im = 0, t = 0;
+    for (uint32_t i = 0; i < length; i++)
+    {
+        double n = frames[i * 3] + 1, on = t + frames[i * 3 + 2], off = t + n;
+        // (e^(-jw on) - e^(-jw off)) / (j 2 pi k)
+        re += sin(w * off) - sin(w * on);
+        im += cos(w * off) - cos(w * on);
+        t = off;
+    }
+    return sqrt(re * re + im * im) / (2 * SPREAD_PI * k);
+}
+
+/*********************************************************************
+ * @fn      check_spread_spectrum
+ *
+ * @brief   Compare the carrier band of the spread output with the line of the constant carrier:
+ *          the highest line has to drop by at least min_db, the band has to keep the carrier power
+ *          (duty cycles are constant, so power only moves into sidebands) and the average stays
+ *          the duty cycle.
+ */
+static void check_spread_spectrum(uint8_t profile, uint16_t permille, uint32_t f_mod, double min_db)
+{
+    char msg[96];
+    TEST_ASSERT_EQUAL(PWM_OK, enable_pwm_spread(&group, permille, f_mod, profile, buffer, sizeof(buffer) / 2));
+    uint32_t length = SPREAD_F_BASE / f_mod;
+    double duty = 1.0 - (double)pwm.duty_cycle / (pwm.arr + 1);    // Duty cycle of the nominal compare value
+    double carrier = sin(SPREAD_PI * duty) / SPREAD_PI;             // Fundamental of the constant carrier
+
+    // ---------- Lines of the carrier band, deviation plus a few modulation frequencies ----------
+    uint32_t reach = (uint32_t)(length * permille / 1000.0 * 1.2) + 8;
+    double peak = 0, power = 0;
+    for (uint32_t k = length - reach; k <= length + reach; k++)
+    {
+        double a = calc_spread_line(buffer, length, k);
+        if (a > peak) peak = a;
+        power += a * a;
+    }
+    double drop = 20 * log10(carrier / peak);
+    snprintf(msg, sizeof(msg), "profile %u +-%u permille at %lu Hz: carrier peak -%.1f dB, band power %.3f",
+             profile, permille, (unsigned long)f_mod, drop, power / (carrier * carrier));
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_TRUE(drop >= min_db);
+    TEST_ASSERT_FLOAT_WITHIN(0.05, 1.0, power / (carrier * carrier));
+
+    // ---------- Every period and the mean of the output (line 0) keep the duty cycle ----------
+    double high = 0, total = 0;
+    for (uint32_t i = 0; i < length; i++)
+    {
+        double n = buffer[i * 3] + 1, on = n - buffer[i * 3 + 2];
+        TEST_ASSERT_FLOAT_WITHIN(0.5 / n, duty, on / n);            // Rounded to one count
+        high += on;
+        total += n;
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.001, duty, high / total);
+    disable_pwm_spread(&group);
+}
+
+// Reference: frames of a zero-width profile give one line of the expected height
+static void test_spread_reference_line(void)
+{
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        buffer[i * 3] = 7199;
+        buffer[i * 3 + 2] = 7200 - SPREAD_DUTY;
+    }
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, sin(SPREAD_PI * 0.25) / SPREAD_PI, calc_spread_line(buffer, 100, 100));
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 0, calc_spread_line(buffer, 100, 101));
+}
+
+// Triangle profile: lines spread over the deviation, about 10 * log10(2 * df / f_mod) below the carrier
+static void test_spread_triangle_spectrum(void)
+{
+    check_spread_spectrum(PWM_SPREAD_TRIANGLE, 50, 100, 8.0);      // +-1kHz in 100Hz steps
+    check_spread_spectrum(PWM_SPREAD_TRIANGLE, 20, 200, 3.0);      // +-400Hz in 200Hz steps
+}
+
+// Random profile: power of the lines scatters, but no dominant line is left
+static void test_spread_random_spectrum(void)
+{
+    check_spread_spectrum(PWM_SPREAD_RANDOM, 50, 100, 4.0);
+}
+
+// Average frequency is reported while spreading, the nominal one again afterwards
+static void test_spread_reports_frequency(void)
+{
+    uint32_t f_avg = pwm.f_avg_millihz;
+    uint32_t f_actual = pwm.f_actual;
+    int32_t ppm = pwm.f_error_ppm;
+    TEST_ASSERT_EQUAL(PWM_OK, enable_pwm_spread(&group, 50, 100, PWM_SPREAD_TRIANGLE, buffer, sizeof(buffer) / 2));
+    TEST_ASSERT_NOT_EQUAL(0, pwm.jitter_ps);
+    TEST_ASSERT_UINT32_WITHIN(SPREAD_F_BASE * 3, SPREAD_F_BASE * 1000, pwm.f_avg_millihz);     // Within 0.3%
+    disable_pwm_spread(&group);
+    TEST_ASSERT_EQUAL_UINT32(f_avg, pwm.f_avg_millihz);
+    TEST_ASSERT_EQUAL_UINT32(f_actual, pwm.f_actual);
+    TEST_ASSERT_EQUAL_INT32(ppm, pwm.f_error_ppm);
+    TEST_ASSERT_EQUAL_UINT32(0, pwm.jitter_ps);
+}
+
+// Update interrupt frequency dithering writes ATRLR itself, spreading has to wait for it
+static void test_spread_busy_while_freq_dither(void)
+{
+    TEST_ASSERT_EQUAL(PWM_OK, enable_pwm_freq_dither(PWM_TIM1, 20000500, NULL, 0));
+    TEST_ASSERT_EQUAL(PWM_ERR_BUSY, enable_pwm_spread(&group, 50, 100, PWM_SPREAD_TRIANGLE, buffer, sizeof(buffer) / 2));
+    disable_pwm_freq_dither(PWM_TIM1);
+    TEST_ASSERT_EQUAL(PWM_OK, enable_pwm_spread(&group, 50, 100, PWM_SPREAD_TRIANGLE, buffer, sizeof(buffer) / 2));
+}
+
+// Neither does frequency dithering start while spreading, the timer is left untouched
+static void test_freq_dither_busy_while_spread(void)
+{
+    TEST_ASSERT_EQUAL(PWM_OK, enable_pwm_spread(&group, 50, 100, PWM_SPREAD_TRIANGLE, buffer, sizeof(buffer) / 2));
+    uint32_t f_avg = pwm.f_avg_millihz;
+    uint16_t arr = pwm.arr;
+    TEST_ASSERT_EQUAL(PWM_ERR_BUSY, enable_pwm_freq_dither(PWM_TIM1, 20000500, NULL, 0));
+    TEST_ASSERT_EQUAL(PWM_ERR_BUSY, enable_pwm_freq_dither(PWM_TIM1, 20000500, buffer + 1024, 256));
+    TEST_ASSERT_FALSE(is_pwm_freq_dither_active(PWM_TIM1));
+    TEST_ASSERT_EQUAL_UINT32(f_avg, pwm.f_avg_millihz);
+    TEST_ASSERT_EQUAL_UINT16(arr, pwm.arr);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_spread_reference_line);
+    RUN_TEST(test_spread_triangle_spectrum);
+    RUN_TEST(test_spread_random_spectrum);
+    RUN_TEST(test_spread_reports_frequency);
+    RUN_TEST(test_spread_busy_while_freq_dither);
+    RUN_TEST(test_freq_dither_busy_while_spread);
+    return UNITY_END();
+}
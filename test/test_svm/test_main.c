@@ -0,0 +1,138 @@
+/**
+ *  CH32VX PWM Library
+ *
+ *  Copyright (c) 2024 Florian Korotschenko aka KingKoro
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ *
+ *
+ *
+ *
+ *  file         : test_main.c
+ *  description  : native tests of the space vector modulation kernel against a floating point reference
+ *
+ */
+
+#include <math.h>
+#include <time.h>
+#include <unity.h>
+#include "ch32v_pwm_svm.h"
+#include "native_sdk.c"
+
+#define SVM_PI          3.14159265358979323846
+#define SVM_DUTY_TOL    (4.0 / 32768)       // Q15 rounding of inputs, intermediate shifts and halving of T0
+#define SVM_BOUND_DEG   0.05                // Sector is ambiguous this close to a sector boundary
+
+void setUp(void) {}
+void tearDown(void) {}
+
+/*********************************************************************
+ * @fn      ref_svm
+ *
+ * @brief   Floating point reference: min-max zero sequence injection, which is equivalent to
+ *          symmetric SVM with T0 split evenly. Beyond the hexagon the vector is scaled back onto it
+ *          at the same angle, like the kernel.
+ */
+static int ref_svm(double m, double theta, double duty[3])
+{
+    double deg = fmod(theta * 180.0 / SVM_PI + 360.0, 360.0);
+    int sector = (int)(deg / 60.0) + 1;
+    double phi = (deg - (sector - 1) * 60.0) * SVM_PI / 180.0;
+    double reach = cos(phi - SVM_PI / 6);                          // T1 + T2 per unit magnitude
+    if (m * reach > 1.0) m = 1.0 / reach;
+    double v[3];
+    for (int k = 0; k < 3; k++) v[k] = m / sqrt(3.0) * cos(theta - k * 2.0 * SVM_PI / 3.0);
+    double hi = fmax(v[0], fmax(v[1], v[2])), lo = fmin(v[0], fmin(v[1], v[2]));
+    for (int k = 0; k < 3; k++) duty[k] = 0.5 + v[k] - (hi + lo) / 2;
+    return sector;
+}
+
+// Duty cycles and sectors over a sweep of angle and magnitude, linear range and overmodulation
+static void test_svm_matches_float_reference(void)
+{
+    char msg[96];
+    double worst = 0;
+    for (int mi = 0; mi <= 24; mi++)
+    {
+        double m = mi * 0.05;                                       // 0 ... 1.2 * PWM_SVM_ONE
+        for (int ai = 0; ai < 1440; ai++)
+        {
+            double deg = ai * 0.25 + 0.01;
+            double theta = deg * SVM_PI / 180.0;
+            int32_t alpha = (int32_t)lround(m * PWM_SVM_ONE * cos(theta));
+            int32_t beta = (int32_t)lround(m * PWM_SVM_ONE * sin(theta));
+            uint16_t duty[3], dwell[3];
+            uint8_t sector = calc_pwm_svm(alpha, beta, duty, dwell);
+            double ref[3];
+            int ref_sector = ref_svm(m, theta, ref);
+            snprintf(msg, sizeof(msg), "m %.2f angle %.2f", m, deg);
+            TEST_ASSERT_TRUE_MESSAGE(sector >= 1 && sector <= 6, msg);
+            double off = fmod(deg, 60.0);
+            if (mi > 0 && off > SVM_BOUND_DEG && off < 60.0 - SVM_BOUND_DEG) TEST_ASSERT_EQUAL_INT_MESSAGE(ref_sector, sector, msg);
+            for (int k = 0; k < 3; k++)
+            {
+                double err = fabs(duty[k] / 32768.0 - ref[k]);
+                if (err > worst) worst = err;
+                TEST_ASSERT_TRUE_MESSAGE(err <= SVM_DUTY_TOL, msg);
+            }
+            TEST_ASSERT_EQUAL_INT_MESSAGE(32768, dwell[0] + dwell[1] + dwell[2], msg);
+        }
+    }
+    snprintf(msg, sizeof(msg), "worst duty deviation %.1f LSB (Q15)", worst * 32768);
+    TEST_MESSAGE(msg);
+}
+
+// Zero vector gives 50% on all phases
+static void test_svm_zero_vector(void)
+{
+    uint16_t duty[3];
+    calc_pwm_svm(0, 0, duty, NULL);
+    for (int k = 0; k < 3; k++) TEST_ASSERT_EQUAL_UINT16(16384, duty[k]);
+}
+
+// Host time per kernel call, the cycle count on the target is printed by the benchmark in src/main.c
+static void test_svm_host_time(void)
+{
+    uint16_t duty[3];
+    volatile uint32_t sink = 0;
+    const uint32_t calls = 1000000;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (uint32_t i = 0; i < calls; i++)
+    {
+        int32_t alpha = (int32_t)(i * 2654435761u >> 16) - 32768;
+        int32_t beta = (int32_t)(i * 40503u & 0xFFFF) - 32768;
+        sink += calc_pwm_svm(alpha, beta, duty, NULL) + duty[0];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / calls;
+    char msg[64];
+    snprintf(msg, sizeof(msg), "calc_pwm_svm: %.1f ns per call on host", ns);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_TRUE(sink != 0);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_svm_matches_float_reference);
+    RUN_TEST(test_svm_zero_vector);
+    RUN_TEST(test_svm_host_time);
+    return UNITY_END();
+}